@@ -80,9 +80,18 @@ int main(int argc, char **argv)
 
         recipe.build_local_maps(decomp);
 
+        auto precision = recipe.get_edge_precision();
+        if (root && (precision.compact_sources || precision.compact_targets)) {
+            std::cout << "compact edges: max position error " << precision.max_position_error
+                      << ", " << precision.merged_sources << " merged sources\n" << std::endl;
+        }
+
         // Construct the model.
         arb::simulation sim(recipe, decomp, context);
 
+        // The network description is no longer needed once the model is built.
+        recipe.release_build_state();
+
         // Set up the probes that will measure voltages in the cells.
         std::unordered_map<cell_member_type, trace_info> traces;
         std::unordered_map<std::string, std::vector<cell_member_type>> trace_groups;
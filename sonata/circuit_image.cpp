@@ -0,0 +1,118 @@
+#include <arbor/common_types.hpp>
+#include <arbor/cable_cell.hpp>
+
+#include <cstring>
+#include <iomanip>
+#include <map>
+#include <sstream>
+#include <string>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "include/sonata_exceptions.hpp"
+#include "include/circuit_image.hpp"
+
+static const char image_magic[8] = {'A', 'R', 'B', 'S', 'O', 'N', 'I', 'M'};
+
+static std::uint64_t align_section(std::uint64_t offset) {
+    return (offset + 63)/64*64;
+}
+
+image_layout::image_layout(const image_header& h) {
+    auto source_size = h.compact_sources ? sizeof(compact_location) : sizeof(source_type);
+
+    cell_kinds = align_section(sizeof(image_header));
+    cells = align_section(cell_kinds + h.num_cells);
+    source_divs = align_section(cells + h.num_cells*sizeof(image_cell));
+    sources = align_section(source_divs + (h.num_cells + 1)*sizeof(unsigned));
+    targets = align_section(sources + h.num_sources*source_size);
+    target_edges = align_section(targets + h.num_incoming*sizeof(target_type));
+    connections = align_section(target_edges + h.num_incoming*sizeof(unsigned));
+    synapses = align_section(connections + h.num_incoming*sizeof(image_connection));
+    size = synapses + h.synapse_bytes;
+}
+
+image_header make_image_header(std::uint64_t key) {
+    image_header h;
+    std::memset(&h, 0, sizeof(h));
+    std::memcpy(h.magic, image_magic, sizeof(image_magic));
+    h.version = circuit_image_version;
+    h.key = key;
+    return h;
+}
+
+std::string write_synapses(const synapse_table& synapses) {
+    std::ostringstream o;
+    o << std::setprecision(17);
+    for (unsigned i = 0; i < synapses.size(); i++) {
+        auto& desc = synapses[i];
+        o << desc.name();
+
+        // Parameters in name order, so that equal descriptions give equal lines
+        std::map<std::string, double> values(desc.values().begin(), desc.values().end());
+        for (auto& v: values) {
+            o << ' ' << v.first << '=' << v.second;
+        }
+        o << '\n';
+    }
+    return o.str();
+}
+
+std::vector<arb::mechanism_desc> read_synapses(const char* data, std::size_t size) {
+    std::vector<arb::mechanism_desc> out;
+
+    std::istringstream lines(std::string(data, size));
+    std::string line;
+    while (std::getline(lines, line)) {
+        std::istringstream fields(line);
+        std::string name, field;
+        fields >> name;
+
+        arb::mechanism_desc desc(name);
+        while (fields >> field) {
+            auto eq = field.find('=');
+            if (eq == std::string::npos) {
+                throw sonata_exception(pprintf("Invalid synapse description in circuit image: {}", line));
+            }
+            desc.set(field.substr(0, eq), std::atof(field.c_str() + eq + 1));
+        }
+        out.push_back(std::move(desc));
+    }
+    return out;
+}
+
+std::shared_ptr<circuit_image> circuit_image::open(const std::string& path, std::uint64_t key, std::uint64_t num_cells) {
+    int fd = ::open(path.c_str(), O_RDONLY);
+    if (fd < 0) {
+        return nullptr;
+    }
+
+    struct stat st;
+    if (fstat(fd, &st) != 0 || (std::uint64_t)st.st_size < sizeof(image_header)) {
+        ::close(fd);
+        return nullptr;
+    }
+
+    std::size_t size = st.st_size;
+    void* base = mmap(nullptr, size, PROT_READ, MAP_SHARED, fd, 0);
+    ::close(fd);
+    if (base == MAP_FAILED) {
+        return nullptr;
+    }
+    std::shared_ptr<void> mapping(base, [size](void* p) { munmap(p, size); });
+
+    // An image of another circuit or version, or a truncated file, is ignored and rewritten
+    auto header = static_cast<const image_header*>(base);
+    if (std::memcmp(header->magic, image_magic, sizeof(image_magic)) ||
+        header->version != circuit_image_version ||
+        header->key != key ||
+        header->num_cells != num_cells ||
+        image_layout(*header).size > size) {
+        return nullptr;
+    }
+
+    return std::shared_ptr<circuit_image>(new circuit_image(std::move(mapping), static_cast<const char*>(base), header));
+}
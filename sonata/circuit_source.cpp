@@ -0,0 +1,80 @@
+#include <arbor/common_types.hpp>
+#include <arbor/cable_cell.hpp>
+
+#include <algorithm>
+#include <fstream>
+#include <map>
+#include <string>
+
+#include <sys/stat.h>
+
+#include "include/flat_hash_map.hpp"
+#include "include/circuit_source.hpp"
+
+std::uint64_t hash_string(const std::string& s, std::uint64_t seed) {
+    // The length separates consecutive strings
+    auto n = (std::uint64_t)s.size();
+    return hash_bytes(s.data(), s.size(), hash_bytes(&n, sizeof(n), seed));
+}
+
+std::uint64_t hash_file_contents(const std::string& path, std::uint64_t seed) {
+    struct stat st;
+    if (stat(path.c_str(), &st) != 0 || !S_ISREG(st.st_mode)) {
+        return hash_string(path, seed);
+    }
+
+    std::ifstream f(path, std::ios::binary);
+    char buffer[1 << 16];
+    std::uint64_t h = seed;
+    while (f.read(buffer, sizeof(buffer)) || f.gcount()) {
+        h = hash_bytes(buffer, f.gcount(), h);
+    }
+    return h;
+}
+
+std::uint64_t hash_file_identity(const std::string& path, std::uint64_t seed) {
+    auto h = hash_string(path, seed);
+
+    struct stat st;
+    if (stat(path.c_str(), &st) == 0) {
+        std::uint64_t size = st.st_size, mtime = st.st_mtime;
+        h = hash_bytes(&size, sizeof(size), h);
+        h = hash_bytes(&mtime, sizeof(mtime), h);
+    }
+    return h;
+}
+
+// Fields of every type, in a fixed order; values that name files are hashed by contents
+static std::uint64_t hash_type_table(const csv_record& types, std::uint64_t seed) {
+    auto ids = types.unique_ids();
+    std::sort(ids.begin(), ids.end(), [](const type_pop_id& a, const type_pop_id& b) {
+        return std::make_pair(a.pop_name(), a.type_tag) < std::make_pair(b.pop_name(), b.type_tag);
+    });
+
+    auto h = seed;
+    for (auto& id: ids) {
+        h = hash_string(id.pop_name(), h);
+        h = hash_bytes(&id.type_tag, sizeof(id.type_tag), h);
+
+        auto fields = types.fields(id);
+        std::map<std::string, std::string> sorted(fields.begin(), fields.end());
+        for (auto& f: sorted) {
+            h = hash_string(f.first, h);
+            h = hash_file_contents(f.second, h);
+        }
+    }
+    return h;
+}
+
+std::uint64_t sonata_file_circuit::content_hash() const {
+    std::uint64_t h = hash_string("sonata_file_circuit", 0xcbf29ce484222325ull);
+    for (auto& f: nodes_.file_names()) {
+        h = hash_file_identity(f, h);
+    }
+    for (auto& f: edges_.file_names()) {
+        h = hash_file_identity(f, h);
+    }
+    h = hash_type_table(node_types_, h);
+    h = hash_type_table(edge_types_, h);
+    return h;
+}
@@ -2,9 +2,18 @@
 #include <arbor/swcio.hpp>
 #include <arbor/segment.hpp>
 
+#include <algorithm>
+#include <cstdlib>
+#include <cstring>
+#include <limits>
 #include <string>
 #include <fstream>
 
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
 #include "include/sonata_exceptions.hpp"
 #include "include/density_mech_helper.hpp"
 #include "include/csv_lib.hpp"
@@ -13,30 +22,242 @@ arb::mechanism_desc read_dynamics_params_point(std::string fname);
 std::unordered_map<std::string, mech_groups> read_dynamics_params_density_base(std::string fname);
 std::unordered_map<std::string, variable_map> read_dynamics_params_density_override(std::string fname);
 
-csv_file::csv_file(std::string name, char delm) :
-        filename(name), delimeter(delm) {
-    std::ifstream file(name);
+static bool is_blank(char c) {
+    return c == ' ' || c == '\t' || c == '\r';
+}
+
+// Field `f` without its surrounding blanks
+static csv_field trim(csv_field f) {
+    while (f.size && is_blank(*f.data)) {
+        f.data++;
+        f.size--;
+    }
+    while (f.size && is_blank(f.data[f.size - 1])) {
+        f.size--;
+    }
+    return f;
+}
+
+bool parse_int(const csv_field& field, long long& value) {
+    auto f = trim(field);
+    auto p = f.data, end = f.data + f.size;
+
+    bool negative = p != end && *p == '-';
+    if (p != end && (*p == '-' || *p == '+')) {
+        p++;
+    }
+    if (p == end) {
+        return false;
+    }
+
+    unsigned long long v = 0;
+    for (; p != end; p++) {
+        if (*p < '0' || *p > '9' || v > (std::numeric_limits<unsigned long long>::max() - 9)/10) {
+            return false;
+        }
+        v = 10*v + (*p - '0');
+    }
+    if (v > (unsigned long long)std::numeric_limits<long long>::max() + negative) {
+        return false;
+    }
+    value = negative ? -(long long)(v - 1) - 1 : (long long)v;
+    return true;
+}
+
+bool parse_double(const csv_field& field, double& value) {
+    static const double powers[] = {1e0,  1e1,  1e2,  1e3,  1e4,  1e5,  1e6,  1e7,  1e8,  1e9,  1e10, 1e11,
+                                    1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22};
+    auto f = trim(field);
+    auto p = f.data, end = f.data + f.size;
+
+    // Fast path: [sign] digits [. digits] [e [sign] digits], with the significand exact in a double
+    bool negative = p != end && *p == '-';
+    if (p != end && (*p == '-' || *p == '+')) {
+        p++;
+    }
+    std::uint64_t significand = 0;
+    int digits = 0, exponent = 0;
+    bool any_digit = false, fast = true;
+    for (; p != end && *p >= '0' && *p <= '9'; p++, any_digit = true) {
+        if (significand || *p != '0') {
+            significand = 10*significand + (*p - '0');
+            fast &= ++digits <= 15;
+        }
+    }
+    if (p != end && *p == '.') {
+        for (p++; p != end && *p >= '0' && *p <= '9'; p++, any_digit = true) {
+            if (significand || *p != '0') {
+                significand = 10*significand + (*p - '0');
+                fast &= ++digits <= 15;
+            }
+            exponent--;
+        }
+    }
+    if (any_digit && p != end && (*p == 'e' || *p == 'E')) {
+        long long e;
+        if (!parse_int({p + 1, std::size_t(end - p - 1)}, e) || e > 1000 || e < -1000) {
+            fast = false;
+        }
+        else {
+            exponent += e;
+            p = end;
+        }
+    }
+    fast &= any_digit && p == end && exponent >= -22 && exponent <= 22;
+
+    if (fast) {
+        double v = significand;
+        v = exponent < 0 ? v/powers[-exponent] : v*powers[exponent];
+        value = negative ? -v : v;
+        return true;
+    }
 
-    if (!file.good()) {
-        throw std::runtime_error("Unable to open csv file: " + name);
+    // Everything else: long significands, large exponents, inf and nan
+    std::string s = f.str();
+    char* stop;
+    value = std::strtod(s.c_str(), &stop);
+    return !s.empty() && stop == s.c_str() + s.size();
+}
+
+long long csv_field::as_int() const {
+    long long v;
+    if (!parse_int(*this, v)) {
+        throw sonata_exception(pprintf("Invalid integer in csv file: \"{}\"", str()));
     }
+    return v;
+}
 
-    std::string line;
+double csv_field::as_double() const {
+    double v;
+    if (!parse_double(*this, v)) {
+        throw sonata_exception(pprintf("Invalid number in csv file: \"{}\"", str()));
+    }
+    return v;
+}
 
-    while (getline(file, line)) {
-        std::vector<std::string> vec;
-        std::stringstream ss(line);
-        std::string value;
+csv_view::csv_view(const std::string& path, char delimiter) {
+    int fd = ::open(path.c_str(), O_RDONLY);
+    struct stat st;
+    if (fd < 0 || fstat(fd, &st) != 0) {
+        if (fd >= 0) ::close(fd);
+        throw sonata_exception("Unable to open csv file: " + path);
+    }
 
-        while(getline(ss, value, delimeter)) {
-            vec.push_back(value);
+    std::size_t size = st.st_size;
+    const char* first = nullptr;
+    if (size > 0) {
+        void* base = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (base == MAP_FAILED) {
+            ::close(fd);
+            throw sonata_exception("Unable to map csv file: " + path);
         }
-        data.push_back(vec);
+        madvise(base, size, MADV_SEQUENTIAL);
+        mapping_ = std::shared_ptr<void>(base, [size](void* p) { munmap(p, size); });
+        first = static_cast<const char*>(base);
     }
-    file.close();
+    ::close(fd);
+
+    // Comma separated unless the header has no comma and a space
+    if (!delimiter) {
+        auto eol = first ? static_cast<const char*>(std::memchr(first, '\n', size)) : nullptr;
+        auto header_end = eol ? eol : first + size;
+        bool comma = std::find(first, header_end, ',') != header_end;
+        bool space = std::find(first, header_end, ' ') != header_end;
+        delimiter = !comma && space ? ' ' : ',';
+    }
+    split(first, first + size, delimiter);
+}
+
+csv_view::csv_view(const std::vector<std::vector<std::string>>& rows) {
+    for (auto& r: rows) {
+        for (auto& f: r) {
+            text_ += f;
+        }
+    }
+
+    divs_.push_back(0);
+    std::size_t offset = 0;
+    for (auto& r: rows) {
+        for (auto& f: r) {
+            fields_.push_back({text_.data() + offset, f.size()});
+            offset += f.size();
+        }
+        divs_.push_back(fields_.size());
+    }
+}
+
+void csv_view::split(const char* first, const char* last, char delimiter) {
+    divs_.push_back(0);
+    for (auto line = first; line < last;) {
+        auto eol = static_cast<const char*>(std::memchr(line, '\n', last - line));
+        if (!eol) {
+            eol = last;
+        }
+        auto end = eol;
+        if (end != line && end[-1] == '\r') {
+            end--;
+        }
+
+        if (delimiter == ' ') {
+            // Runs of blanks separate fields, leading and trailing blanks are ignored
+            for (auto p = line; p < end;) {
+                while (p < end && is_blank(*p)) p++;
+                auto q = p;
+                while (q < end && !is_blank(*q)) q++;
+                if (q > p) {
+                    fields_.push_back({p, std::size_t(q - p)});
+                }
+                p = q;
+            }
+        }
+        else if (std::find_if(line, end, [](char c) { return !is_blank(c); }) != end) {
+            for (auto p = line;; ) {
+                auto q = std::find(p, end, delimiter);
+                fields_.push_back({p, std::size_t(q - p)});
+                if (q == end) break;
+                p = q + 1;
+            }
+        }
+
+        if (fields_.size() > divs_.back()) {
+            divs_.push_back(fields_.size());
+        }
+        line = eol + 1;
+    }
+}
+
+int csv_view::column(const std::string& name) const {
+    if (num_rows() == 0) {
+        return -1;
+    }
+    auto header = (*this)[0];
+    for (unsigned i = 0; i < header.size(); i++) {
+        if (header[i] == name) {
+            return i;
+        }
+    }
+    return -1;
+}
+
+csv_file::csv_file(std::string name, char delm) :
+        filename(name), view_(std::make_shared<csv_view>(name, delm)) {}
+
+csv_file::csv_file(std::string name, std::vector<std::vector<std::string>> rows) :
+        filename(name), view_(std::make_shared<csv_view>(rows)) {}
+
+const csv_view& csv_file::view() const {
+    return *view_;
 }
 
 std::vector<std::vector<std::string>> csv_file::get_data() {
+    std::vector<std::vector<std::string>> data;
+    data.reserve(view_->num_rows());
+    for (std::size_t i = 0; i < view_->num_rows(); i++) {
+        data.emplace_back();
+        for (auto& f: (*view_)[i]) {
+            data.back().push_back(f.str());
+        }
+    }
     return data;
 }
 
@@ -47,80 +268,169 @@ std::string csv_file::name() {
 ////////////////////////////////////////////////////////
 
 csv_record::csv_record(std::vector<csv_file> files) {
-    for (auto f: files) {
-        auto csv_data = f.get_data();
-        auto col_names = csv_data.front();
-
-        for(auto it = csv_data.begin()+1; it < csv_data.end(); it++) {
-            std::unordered_map<std::string, std::string> type_fields(csv_data.front().size() - 1);
-            unsigned type_tag, loc = 0;
-            std::string pop_name;
-
-            for (auto field: *it) {
-                if (col_names[loc].find("type_id") != std::string::npos) {
-                    type_tag = std::atoi(field.c_str());
+    for (auto& f: files) {
+        auto& table = f.view();
+        if (table.num_rows() == 0) {
+            continue;
+        }
+
+        // Column of every field of the file; the type id is not stored
+        auto header = table[0];
+        int type_col = -1, pop_col = -1;
+        std::vector<unsigned> cols(header.size());
+        for (unsigned loc = 0; loc < header.size(); loc++) {
+            auto name = header[loc].str();
+            if (name.find("type_id") != std::string::npos) {
+                type_col = loc;
+                continue;
+            }
+            if (name == "pop_name") {
+                pop_col = loc;
+            }
+            auto it = column_ids_.find(name);
+            if (it == column_ids_.end()) {
+                it = column_ids_.insert({name, (unsigned)columns_.size()}).first;
+                columns_.emplace_back();
+                auto& c = columns_.back();
+                c.name = name;
+                c.strings.resize(rows_.size());
+                c.numbers.resize(rows_.size(), 0);
+                c.set.resize(rows_.size(), 0);
+                c.numeric.resize(rows_.size(), 0);
+            }
+            cols[loc] = it->second;
+        }
+
+        for (std::size_t r = 1; r < table.num_rows(); r++) {
+            auto fields = table[r];
+            unsigned type_tag = type_col >= 0 && (unsigned)type_col < fields.size() ? fields[type_col].as_int() : 0;
+            auto pop_name = pop_col >= 0 && (unsigned)pop_col < fields.size() ? fields[pop_col].str() : std::string();
+            type_pop_id id(type_tag, pop_name);
+
+            // A type given again replaces its previous fields
+            auto it = rows_.find(id);
+            if (it == rows_.end()) {
+                it = rows_.insert({id, (unsigned)ids_.size()}).first;
+                ids_.push_back(id);
+                for (auto& c: columns_) {
+                    c.strings.emplace_back();
+                    c.numbers.push_back(0);
+                    c.set.push_back(0);
+                    c.numeric.push_back(0);
                 }
-                else {
-                    if (col_names[loc] == "pop_name") {
-                        pop_name = field;
-                    }
-                    type_fields[col_names[loc]] = field;
+            }
+            auto row = it->second;
+            for (auto& c: columns_) {
+                c.strings[row].clear();
+                c.set[row] = c.numeric[row] = 0;
+            }
+
+            for (unsigned loc = 0; loc < fields.size() && loc < header.size(); loc++) {
+                if ((int)loc == type_col || fields[loc].size == 0) {
+                    continue;
                 }
-                loc++;
+                auto& c = columns_[cols[loc]];
+                c.strings[row] = fields[loc].str();
+                c.set[row] = 1;
+                c.numeric[row] = parse_double(fields[loc], c.numbers[row]);
             }
-            fields_[type_pop_id(type_tag, pop_name)] = type_fields;
-            ids_.emplace_back(type_tag, pop_name);
         }
     }
 }
 
-std::unordered_map<std::string, std::string> csv_record::fields(type_pop_id id) {
-    if (fields_.find(id) != fields_.end()) {
-        return fields_[id];
+unsigned csv_record::row(type_pop_id id) const {
+    auto it = rows_.find(id);
+    if (it == rows_.end()) {
+        throw sonata_exception(pprintf("Type {} of population {} not found in csv type tables", id.type_tag, id.pop_name()));
+    }
+    return it->second;
+}
+
+field_map csv_record::fields(type_pop_id id) const {
+    auto r = row(id);
+    field_map ret;
+    for (auto& c: columns_) {
+        if (c.set[r]) {
+            ret[c.name] = c.strings[r];
+        }
     }
-    throw sonata_exception("Requested CSV column not found");
+    return ret;
+}
+
+int csv_record::column_id(const std::string& name) const {
+    auto it = column_ids_.find(name);
+    return it == column_ids_.end() ? -1 : (int)it->second;
+}
+
+bool csv_record::has_field(type_pop_id id, int col) const {
+    auto r = row(id);
+    return col >= 0 && columns_[col].set[r];
 }
 
-std::vector<type_pop_id> csv_record::unique_ids() {
+unsigned csv_record::field_row(type_pop_id id, int col) const {
+    auto r = row(id);
+    if (col < 0 || !columns_[col].set[r]) {
+        throw sonata_exception(pprintf("Field {} of type {} of population {} not found in csv type tables",
+                                       col >= 0 ? columns_[col].name : std::string("?"), id.type_tag, id.pop_name()));
+    }
+    return r;
+}
+
+const std::string& csv_record::string_field(type_pop_id id, int col) const {
+    auto r = field_row(id, col);
+    return columns_[col].strings[r];
+}
+
+double csv_record::double_field(type_pop_id id, int col) const {
+    auto r = field_row(id, col);
+    if (!columns_[col].numeric[r]) {
+        throw sonata_exception(pprintf("Field {} of type {} of population {} is not a number: \"{}\"",
+                                       columns_[col].name, id.type_tag, id.pop_name(), columns_[col].strings[r]));
+    }
+    return columns_[col].numbers[r];
+}
+
+std::vector<type_pop_id> csv_record::unique_ids() const {
     return ids_;
 }
 
 ////////////////////////////////////////////////////////
 
 csv_node_record::csv_node_record(std::vector<csv_file> files) : csv_record(files) {
-    for (auto type: fields_) {
-        if (type.second.find("model_type") == type.second.end()) {
+    for (auto& id: ids_) {
+        auto type = fields(id);
+        if (type.find("model_type") == type.end()) {
             throw sonata_exception("Model_type not found in node csv description");
         }
-        std::string model_type = type.second["model_type"];
+        std::string model_type = type["model_type"];
 
         if (model_type != "virtual") {
-            if (type.second.find("morphology") != type.second.end()) {
-                if (type.second["morphology"] == "NULL") {
+            if (type.find("morphology") != type.end()) {
+                if (type["morphology"] == "NULL") {
                     throw sonata_exception("Morphology of non-virtual cell can not be NULL");
                 }
-                std::ifstream f(type.second["morphology"]);
+                std::ifstream f(type["morphology"]);
                 if (!f) throw sonata_exception("Unable to open SWC file");
-                morphologies_[type.first] = arb::swc_as_morphology(arb::parse_swc_file(f));
+                morphologies_[id] = arb::swc_as_morphology(arb::parse_swc_file(f));
             } else {
                 throw sonata_exception("Morphology not found in node csv description");
             }
 
-            if (type.second.find("model_template") != type.second.end()) {
-                if (type.second["model_template"] == "NULL") {
+            if (type.find("model_template") != type.end()) {
+                if (type["model_template"] == "NULL") {
                     throw sonata_exception("Model_template of non-virtual cell can not be NULL");
                 }
                 density_params_.insert(
-                        {type.first, std::move(read_dynamics_params_density_base(type.second["model_template"]))});
+                        {id, std::move(read_dynamics_params_density_base(type["model_template"]))});
             } else {
                 throw sonata_exception("Model_template not found in node csv description");
             }
 
-            if (type.second.find("dynamics_params") != type.second.end()) {
-                if (type.second["dynamics_params"] != "NULL") {
+            if (type.find("dynamics_params") != type.end()) {
+                if (type["dynamics_params"] != "NULL") {
                     auto dyn_params = std::move(
-                            read_dynamics_params_density_override(type.second["dynamics_params"]));
-                    override_density_params(type.first, std::move(dyn_params));
+                            read_dynamics_params_density_override(type["dynamics_params"]));
+                    override_density_params(id, std::move(dyn_params));
                 }
             }
         }
@@ -135,7 +445,7 @@ arb::morphology csv_node_record::morph(type_pop_id id) {
 }
 
 arb::cell_kind csv_node_record::cell_kind(type_pop_id id) {
-    if (fields_[id]["model_type"] == "virtual") {
+    if (string_field(id, column_id("model_type")) == "virtual") {
         return arb::cell_kind::spike_source;
     }
     return arb::cell_kind::cable;
@@ -170,6 +480,32 @@ std::unordered_map<std::string, std::vector<arb::mechanism_desc>> csv_node_recor
     return ret;
 }
 
+std::unordered_map<std::string, std::vector<arb::mechanism_desc>> csv_node_record::density_mech_desc(
+        type_pop_id id, const std::unordered_map<std::string, variable_map>& override) {
+    std::unordered_map<std::string, std::vector<arb::mechanism_desc>> ret;
+
+    std::unordered_map<std::string, mech_groups> density_mechs = density_params_[id];
+
+    // For every mech_id
+    for (auto mech: density_mechs) {
+        auto mech_gp = mech.second;
+
+        if (override.find(mech.first) != override.end()) {
+            for (auto var: override.at(mech.first)) {
+                if (mech_gp.variables.find(var.first) != mech_gp.variables.end()) {
+                    mech_gp.variables[var.first] = var.second;
+                }
+            }
+        }
+        mech_gp.apply_variables();
+
+        for (auto mech_instance: mech_gp.mech_details) {
+            ret[mech_instance.section].push_back(mech_instance.mech);
+        }
+    }
+    return ret;
+}
+
 void csv_node_record::override_density_params(type_pop_id id, std::unordered_map<std::string, variable_map> override) {
     auto& base = density_params_[id];
 
@@ -191,25 +527,26 @@ void csv_node_record::override_density_params(type_pop_id id, std::unordered_map
 ////////////////////////////////////////////////////////////////////////////////////////////////////////////
 
 csv_edge_record::csv_edge_record(std::vector<csv_file> files) : csv_record(files) {
-    for (auto type: fields_) {
-        if (type.second.find("model_template") == type.second.end()) {
+    for (auto& id: ids_) {
+        auto type = fields(id);
+        if (type.find("model_template") == type.end()) {
             throw sonata_exception("Model_template not found in node csv description");
         }
 
-        if (type.second.find("dynamics_params") != type.second.end()) {
-            if (type.second["dynamics_params"] != "NULL") {
-                auto mech = read_dynamics_params_point(type.second["dynamics_params"]);
+        if (type.find("dynamics_params") != type.end()) {
+            if (type["dynamics_params"] != "NULL") {
+                auto mech = read_dynamics_params_point(type["dynamics_params"]);
 
-                if (mech.name() != type.second["model_template"]) {
+                if (mech.name() != type["model_template"]) {
                     throw sonata_exception("point mechanism in \'dynamics_params\' does not match \'model_template\'");
                 }
 
-                point_params_.insert({type.first, std::move(mech)});
+                point_params_.insert({id, std::move(mech)});
             } else {
-                point_params_.insert({type.first, arb::mechanism_desc(type.second["model_template"])});
+                point_params_.insert({id, arb::mechanism_desc(type["model_template"])});
             }
         } else {
-            point_params_.insert({type.first, arb::mechanism_desc(type.second["model_template"])});
+            point_params_.insert({id, arb::mechanism_desc(type["model_template"])});
         }
     }
 }
@@ -1,7 +1,19 @@
 #include <arbor/version.hpp>
 #include <arbor/mechcat.hpp>
 
+#include <cmath>
+#include <cstdio>
+#include <fstream>
+#include <iomanip>
+#include <limits>
+#include <map>
+#include <sstream>
+#include <thread>
+
+#include <unistd.h>
+
 #include "include/data_management_lib.hpp"
+#include "include/edge_index.hpp"
 #include "mpi_helper.hpp"
 
 using arb::cell_gid_type;
@@ -10,6 +22,50 @@ using arb::cell_size_type;
 using arb::cell_member_type;
 using arb::segment_location;
 
+void database::release_build_state() {
+    // Swap with empty objects, so that the memory is actually returned
+    nodes_ = h5_record(std::vector<std::shared_ptr<h5_group>>());
+    edges_ = h5_record(std::vector<std::shared_ptr<h5_group>>());
+    node_types_ = csv_node_record({});
+    edge_types_ = csv_edge_record({});
+
+    decltype(clamp_inputs_)().swap(clamp_inputs_);
+    decltype(current_clamps_)().swap(current_clamps_);
+    decltype(spikes_)().swap(spikes_);
+
+    decltype(uniform_nodes_)().swap(uniform_nodes_);
+    decltype(uniform_edges_)().swap(uniform_edges_);
+    decltype(edge_groups_)().swap(edge_groups_);
+
+    arena_.release();
+    image_.reset();
+    image_cells_ = {};
+    image_targets_ = {};
+    image_target_edges_ = {};
+    image_connections_ = {};
+    decltype(image_synapses_)().swap(image_synapses_);
+    decltype(local_gids_)().swap(local_gids_);
+    local_nodes_ = node_columns();
+    density_overrides_ = density_override_table();
+
+    decltype(spike_divs_)().swap(spike_divs_);
+    decltype(spike_times_)().swap(spike_times_);
+
+    source_divs_ = {};
+    source_maps_ = {};
+    compact_source_maps_ = {};
+
+    targets_ = target_table();
+    decltype(group_gids_)().swap(group_gids_);
+    decltype(local_groups_)().swap(local_groups_);
+    decltype(local_rows_)().swap(local_rows_);
+    decltype(group_targets_)().swap(group_targets_);
+    decltype(resident_groups_)().swap(resident_groups_);
+    synapses_ = synapse_table();
+
+    released_ = true;
+}
+
 void database::build_current_clamp_map(std::vector<current_clamp_info> current) {
 
     struct param_info {
@@ -24,64 +80,85 @@ void database::build_current_clamp_map(std::vector<current_clamp_info> current)
         unsigned seg;
         double pos;
     };
-    for (auto curr_clamp : current){
+
+    auto pop_map = nodes_.map();
+
+    for (auto& curr_clamp : current){
         std::unordered_map<unsigned, param_info> param_map;
         std::unordered_map<unsigned, loc_info> loc_map;
 
-        auto stim_param_data = curr_clamp.stim_params.get_data();
-        auto stim_param_cols = stim_param_data.front();
+        // Columns are looked up once per table, fields are parsed in place
+        auto column = [](const csv_file& f, const char* name) {
+            auto c = f.view().column(name);
+            if (c < 0) {
+                throw sonata_exception(pprintf("Missing column {} in csv file", name));
+            }
+            return (unsigned)c;
+        };
 
-        for(auto it = stim_param_data.begin()+1; it < stim_param_data.end(); it++) {
+        auto& stim_params = curr_clamp.stim_params.view();
+        auto electrode_col = column(curr_clamp.stim_params, "electrode_id");
+        auto node_col = column(curr_clamp.stim_params, "node_id");
+        auto population_col = column(curr_clamp.stim_params, "population");
+        auto sec_col = column(curr_clamp.stim_params, "sec_id");
+        auto seg_col = column(curr_clamp.stim_params, "seg_x");
+
+        for (std::size_t r = 1; r < stim_params.num_rows(); r++) {
+            auto row = stim_params[r];
+            if (row.size() != stim_params[0].size()) {
+                throw sonata_exception(pprintf("Row {} of csv file {} has {} fields, expected {}",
+                                               r, curr_clamp.stim_params.name(), row.size(), stim_params[0].size()));
+            }
             loc_info loc;
-            unsigned pos = 0, id;
-
-            for (auto field: *it) {
-                if(stim_param_cols[pos] == "electrode_id") {
-                    id = std::atoi(field.c_str());
-                } else if (stim_param_cols[pos] == "node_id") {
-                    loc.gid = std::atoi(field.c_str());
-                } else if (stim_param_cols[pos] == "population") {
-                    loc.population = field;
-                } else if (stim_param_cols[pos] == "sec_id") {
-                    loc.seg = std::atoi(field.c_str());
-                } else if (stim_param_cols[pos] == "seg_x") {
-                    loc.pos = std::atof(field.c_str());
-                }
-                pos++;
+            unsigned id = row[electrode_col].as_int();
+            loc.gid = row[node_col].as_int();
+            loc.population = row[population_col].str();
+            loc.seg = row[sec_col].as_int();
+            loc.pos = row[seg_col].as_double();
+
+            // Only keep the electrodes placed on local cells
+            if (pop_map.find(loc.population) == pop_map.end()) {
+                throw sonata_exception(pprintf("Electrode {} is placed on unknown population {}", id, loc.population));
+            }
+            loc.gid = globalize_cell({pop_map.at(loc.population), loc.gid});
+            if (find_local(loc.gid) != -1) {
+                loc_map[id] = loc;
             }
-            loc_map[id] = loc;
         }
 
-        auto stim_loc_data = curr_clamp.stim_loc.get_data();
-        auto stim_loc_cols = stim_loc_data.front();
+        if (loc_map.empty()) {
+            continue;
+        }
 
-        for(auto it = stim_loc_data.begin()+1; it < stim_loc_data.end(); it++) {
+        auto& stim_loc = curr_clamp.stim_loc.view();
+        auto loc_electrode_col = column(curr_clamp.stim_loc, "electrode_id");
+        auto dur_col = column(curr_clamp.stim_loc, "dur");
+        auto amp_col = column(curr_clamp.stim_loc, "amp");
+        auto delay_col = column(curr_clamp.stim_loc, "delay");
+
+        for (std::size_t r = 1; r < stim_loc.num_rows(); r++) {
+            auto row = stim_loc[r];
+            if (row.size() != stim_loc[0].size()) {
+                throw sonata_exception(pprintf("Row {} of csv file {} has {} fields, expected {}",
+                                               r, curr_clamp.stim_loc.name(), row.size(), stim_loc[0].size()));
+            }
             param_info param;
-            unsigned pos = 0, id;
-
-            for (auto field: *it) {
-                if(stim_loc_cols[pos] == "electrode_id") {
-                    id = std::atoi(field.c_str());
-                } else if (stim_loc_cols[pos] == "dur") {
-                    param.dur = std::atof(field.c_str());
-                } else if (stim_loc_cols[pos] == "amp") {
-                    param.amp = std::atof(field.c_str());
-                } else if (stim_loc_cols[pos] == "delay") {
-                    param.delay = std::atof(field.c_str());
-                }
-                pos++;
+            unsigned id = row[loc_electrode_col].as_int();
+            param.dur = row[dur_col].as_double();
+            param.amp = row[amp_col].as_double();
+            param.delay = row[delay_col].as_double();
+
+            if (loc_map.find(id) != loc_map.end()) {
+                param_map[id] = param;
             }
-            param_map[id] = param;
         }
 
         for (auto i: loc_map) {
             if (param_map.find(i.first) != param_map.end()) {
                 auto params = param_map.at(i.first);
+                auto loc = i.second;
 
-                auto local_loc = i.second;
-                auto global_gid = globalize_cell({local_loc.gid, nodes_.map()[local_loc.population]});
-
-                current_clamps_[global_gid].emplace_back(params.dur, params.amp, params.delay, arb::segment_location(local_loc.seg, local_loc.pos));
+                current_clamps_[loc.gid].emplace_back(params.dur, params.amp, params.delay, arb::segment_location(loc.seg, loc.pos));
             }
             else {
                 throw sonata_exception("Electrode id has no corresponding input description");
@@ -90,21 +167,857 @@ void database::build_current_clamp_map(std::vector<current_clamp_info> current)
     }
 }
 
-void database::build_source_and_target_maps(const std::vector<arb::group_description>& groups) {
-    // Build loc_source_gids and loc_source_sizes
-    std::vector<cell_gid_type> loc_source_gids;
-    std::vector<unsigned> loc_source_sizes;
-    std::vector<source_type> loc_sources;
+void database::build_local_maps(const std::vector<arb::group_description>& groups) {
+    require_build_state();
+    local_gids_.clear();
+    for (auto& group: groups) {
+        local_gids_.insert(local_gids_.end(), group.gids.begin(), group.gids.end());
+    }
+    std::sort(local_gids_.begin(), local_gids_.end());
+
+    // Position of every local cell in the cell groups, for the streaming mode
+    group_gids_.clear();
+    local_groups_.assign(local_gids_.size(), 0);
+    local_rows_.assign(local_gids_.size(), 0);
+    for (unsigned g = 0; g < groups.size(); g++) {
+        group_gids_.push_back(groups[g].gids);
+        for (unsigned r = 0; r < groups[g].gids.size(); r++) {
+            auto lid = local_index(groups[g].gids[r]);
+            local_groups_[lid] = g;
+            local_rows_[lid] = r;
+        }
+    }
+
+    current_clamps_.clear();
+    build_current_clamp_map(std::move(clamp_inputs_));
+    clamp_inputs_.clear();
+
+    build_node_columns();
+    build_density_overrides();
+    if (!image_) {
+        build_uniform_edges();
+    }
+    build_source_and_target_maps();
+    build_spike_map();
+
+    if (!image_ && circuit_key_ && !opts_.circuit_cache.empty()) {
+        write_circuit_image();
+    }
+}
+
+// Key of the image of a circuit: the precision of the sources and the synapse instances are part of the image
+static std::uint64_t image_key(std::uint64_t circuit_key, const database_options& opts) {
+    auto h = hash_bytes(&opts.compact_edges, sizeof(opts.compact_edges), circuit_key);
+    h = hash_bytes(&opts.coalesce_synapses, sizeof(opts.coalesce_synapses), h);
+    h = hash_bytes(&opts.order_targets, sizeof(opts.order_targets), h);
+    if (opts.coalesce_synapses) {
+        for (auto& name: opts.linear_synapses) {
+            h = hash_string(name, h);
+        }
+    }
+    return h;
+}
+
+std::string database::circuit_image_path() const {
+    std::ostringstream path;
+    path << opts_.circuit_cache << "/circuit_"
+         << std::hex << std::setw(16) << std::setfill('0') << image_key(circuit_key_, opts_) << ".img";
+    return path.str();
+}
+
+void database::open_circuit_image() {
+    if (opts_.circuit_cache.empty() || !circuit_key_) {
+        return;
+    }
+    image_ = circuit_image::open(circuit_image_path(), image_key(circuit_key_, opts_), num_cells_);
+#ifdef ARB_MPI_ENABLED
+    // All ranks read the network from the image, or none does
+    if (!min_all(int(image_ != nullptr), MPI_COMM_WORLD)) {
+        image_.reset();
+    }
+#endif
+    if (!image_) {
+        return;
+    }
+
+    image_cells_ = image_->cells();
+    image_targets_ = image_->targets();
+    image_target_edges_ = image_->target_edges();
+    image_connections_ = image_->connections();
+    for (auto& desc: image_->synapses()) {
+        image_synapses_.push_back(synapses_.intern(desc));
+    }
+}
+
+void database::write_circuit_image() {
+    auto header = make_image_header(image_key(circuit_key_, opts_));
+    header.compact_sources = precision_.compact_sources;
+    header.max_position_error = precision_.max_position_error;
+    header.merged_sources = precision_.merged_sources;
+    header.num_cells = num_cells_;
+    header.num_sources = source_divs_[num_cells_];
+
+    // Incoming edges of the local cells, in local_gids_ order, with their targets read at full precision
+    std::vector<image_cell> cells;
+    std::vector<target_type> targets;
+    std::vector<unsigned> target_edges;
+    std::vector<image_connection> connections;
+    cells.reserve(local_gids_.size());
+
+    std::vector<arb::cell_connection> conns;
+    for (auto gid: local_gids_) {
+        target_table table;
+        table.divs.assign(1, 0);
+        append_targets(gid, table);
+
+        conns.clear();
+        get_connections(gid, conns);
+        if (conns.size() != table.maps.size()) {
+            throw sonata_exception(pprintf("Cell {} has {} targets but {} connections", gid, table.maps.size(), conns.size()));
+        }
+
+        auto lid = local_index(gid);
+        image_cell cell;
+        cell.pop_id = local_nodes_.pop_id[lid];
+        cell.type_id = local_nodes_.type_id[lid];
+        cell.group_id = local_nodes_.group_id[lid];
+        cell.group_index = local_nodes_.group_index[lid];
+        cell.first_incoming = targets.size();
+        cell.num_incoming = table.maps.size();
+        cells.push_back(cell);
+
+        targets.insert(targets.end(), table.maps.begin(), table.maps.end());
+        target_edges.insert(target_edges.end(), table.edges.begin(), table.edges.end());
+        for (auto& c: conns) {
+            connections.push_back({c.source.gid, c.source.index, c.dest.index, (float)c.weight, (float)c.delay});
+        }
+    }
+    auto synapse_text = write_synapses(synapses_);
+
+    // The root writes the tables of all cells, then every rank writes its incoming edges at its offset
+    // The image is written to a temporary file, renamed once complete so that readers never see a partial image
+    auto path = circuit_image_path();
+    auto tmp_path = path + ".tmp";
+
+#ifdef ARB_MPI_ENABLED
+    auto comm = MPI_COMM_WORLD;
+    bool root = rank(comm) == 0;
+
+    auto cell_counts = gather_all(local_gids_.size(), comm);
+    auto incoming_divs = make_index(gather_all(targets.size(), comm));
+    auto synapse_divs = make_index(gather_all((std::size_t)synapses_.size(), comm));
+    auto byte_counts = gather_all(synapse_text.size(), comm);
+
+    header.num_incoming = incoming_divs.back();
+    header.num_synapses = synapse_divs.back();
+    header.synapse_bytes = make_index(byte_counts).back();
+
+    // Ids in the image tables of the incoming edges and synapses of this rank
+    auto first_incoming = incoming_divs[rank(comm)];
+    auto first_synapse = synapse_divs[rank(comm)];
+    for (auto& c: cells) {
+        c.first_incoming += first_incoming;
+    }
+    for (auto& t: targets) {
+        t.synapse += first_synapse;
+    }
+
+    std::vector<cell_gid_type> all_gids(root ? num_cells_ : 0);
+    std::vector<image_cell> all_cells(root ? num_cells_ : 0);
+    std::string all_synapses(root ? header.synapse_bytes : 0, '\0');
+    gatherv(local_gids_.data(), local_gids_.size(), all_gids.data(), cell_counts, 0, comm);
+    gatherv(cells.data(), cells.size(), all_cells.data(), cell_counts, 0, comm);
+    gatherv(synapse_text.data(), synapse_text.size(), &all_synapses[0], byte_counts, 0, comm);
+#else
+    bool root = true;
+    std::uint64_t first_incoming = 0;
+
+    header.num_incoming = targets.size();
+    header.num_synapses = synapses_.size();
+    header.synapse_bytes = synapse_text.size();
+
+    const auto& all_gids = local_gids_;
+    const auto& all_cells = cells;
+    const auto& all_synapses = synapse_text;
+#endif
+
+    image_layout layout(header);
+    auto write_at = [](std::ostream& out, std::uint64_t offset, const void* data, std::size_t size) {
+        out.seekp(offset);
+        out.write(static_cast<const char*>(data), size);
+    };
+
+    int created = 1;
+    if (root) {
+        std::vector<image_cell> sorted_cells(num_cells_);
+        for (unsigned i = 0; i < all_gids.size(); i++) {
+            sorted_cells[all_gids[i]] = all_cells[i];
+        }
+
+        std::ofstream out(tmp_path, std::ios::binary | std::ios::trunc);
+        write_at(out, 0, &header, sizeof(header));
+        write_at(out, layout.cell_kinds, cell_kinds_.begin(), num_cells_);
+        write_at(out, layout.cells, sorted_cells.data(), num_cells_*sizeof(image_cell));
+        write_at(out, layout.source_divs, source_divs_.begin(), (num_cells_ + 1)*sizeof(unsigned));
+        if (precision_.compact_sources) {
+            write_at(out, layout.sources, compact_source_maps_.begin(), header.num_sources*sizeof(compact_location));
+        }
+        else {
+            write_at(out, layout.sources, source_maps_.begin(), header.num_sources*sizeof(source_type));
+        }
+        write_at(out, layout.synapses, all_synapses.data(), all_synapses.size());
+        out.close();
+        created = out && ::truncate(tmp_path.c_str(), layout.size) == 0;
+    }
+#ifdef ARB_MPI_ENABLED
+    created = min_all(created, comm);
+#endif
+    if (!created) {
+        std::remove(tmp_path.c_str());
+        throw sonata_exception(pprintf("Unable to write circuit image {}", tmp_path));
+    }
+
+    int written;
+    {
+        std::fstream out(tmp_path, std::ios::binary | std::ios::in | std::ios::out);
+        write_at(out, layout.targets + first_incoming*sizeof(target_type), targets.data(), targets.size()*sizeof(target_type));
+        write_at(out, layout.target_edges + first_incoming*sizeof(unsigned), target_edges.data(), target_edges.size()*sizeof(unsigned));
+        write_at(out, layout.connections + first_incoming*sizeof(image_connection), connections.data(),
+                 connections.size()*sizeof(image_connection));
+        out.close();
+        written = bool(out);
+    }
+#ifdef ARB_MPI_ENABLED
+    written = min_all(written, comm);
+#endif
+    if (root) {
+        if (!written || std::rename(tmp_path.c_str(), path.c_str()) != 0) {
+            std::remove(tmp_path.c_str());
+            written = 0;
+        }
+    }
+#ifdef ARB_MPI_ENABLED
+    written = min_all(written, comm);
+#endif
+    if (!written) {
+        throw sonata_exception(pprintf("Unable to write circuit image {}", path));
+    }
+}
+
+// Reads `ids.size()` values of a dataset at the sorted indices `ids`
+// Nearby indices are coalesced into single range reads, `read(i, j)` returns the values between i and j
+template <typename T, typename Read>
+static std::vector<T> read_indices(const std::vector<unsigned>& ids, Read&& read) {
+    const unsigned max_gap = 4096;
+
+    std::vector<T> out;
+    out.reserve(ids.size());
+    for (unsigned i = 0; i < ids.size();) {
+        unsigned j = i + 1;
+        while (j < ids.size() && ids[j] - ids[j-1] <= max_gap) {
+            j++;
+        }
+
+        auto first = ids[i];
+        auto block = read(first, ids[j-1] + 1);
+        for (; i < j; i++) {
+            out.push_back(block[ids[i] - first]);
+        }
+    }
+    return out;
+}
+
+void database::build_node_columns() {
+    local_nodes_ = node_columns();
+    local_nodes_.pop_id.reserve(local_gids_.size());
+
+    if (image_) {
+        for (auto gid: local_gids_) {
+            auto& c = image_cells_[gid];
+            local_nodes_.pop_id.push_back(c.pop_id);
+            local_nodes_.type_id.push_back(c.type_id);
+            local_nodes_.group_id.push_back(c.group_id);
+            local_nodes_.group_index.push_back(c.group_index);
+        }
+        return;
+    }
+
+    for (unsigned p = 0; p < nodes_.populations().size(); p++) {
+        // Local cells of the population: a contiguous block of local_gids_
+        auto first = std::lower_bound(local_gids_.begin(), local_gids_.end(), nodes_.partitions()[p]);
+        auto last = std::lower_bound(first, local_gids_.end(), nodes_.partitions()[p + 1]);
+
+        std::vector<unsigned> el_ids;
+        for (auto it = first; it != last; it++) {
+            el_ids.push_back(*it - nodes_.partitions()[p]);
+        }
+
+        auto read_column = [&](const char* name, uniform_column col, std::vector<int>& out) {
+            if (col.uniform) {
+                out.insert(out.end(), el_ids.size(), col.value);
+            }
+            else {
+                auto values = read_indices<int>(el_ids, [&](unsigned i, unsigned j) {
+                    return nodes_[p].int_range(name, i, j);
+                });
+                out.insert(out.end(), values.begin(), values.end());
+            }
+        };
+
+        local_nodes_.pop_id.insert(local_nodes_.pop_id.end(), el_ids.size(), p);
+        read_column("node_type_id", uniform_nodes_[p].type_id, local_nodes_.type_id);
+        read_column("node_group_id", uniform_nodes_[p].group_id, local_nodes_.group_id);
+        read_column("node_group_index", {false, 0}, local_nodes_.group_index);
+    }
+}
+
+void database::build_density_overrides() {
+    density_overrides_ = density_override_table();
+
+    // Local cells of every (population, node group), with their index in the group
+    std::map<std::pair<unsigned, int>, std::vector<std::pair<unsigned, unsigned>>> group_cells;
+    for (unsigned lid = 0; lid < local_gids_.size(); lid++) {
+        auto key = std::make_pair(local_nodes_.pop_id[lid], local_nodes_.group_id[lid]);
+        group_cells[key].push_back({(unsigned)local_nodes_.group_index[lid], lid});
+    }
+
+    std::unordered_map<std::string, unsigned> column_ids;
+
+    for (auto& g: group_cells) {
+        auto& pop = nodes_[g.first.first];
+        auto lgi = pop.find_group(std::to_string(g.first.second));
+        if (lgi == -1 || pop[lgi].find_group("dynamics_params") == -1) {
+            continue;
+        }
+        auto& dyn_params = pop[lgi][pop[lgi].find_group("dynamics_params")];
+
+        auto& cells = g.second;
+        std::sort(cells.begin(), cells.end());
+
+        std::vector<unsigned> group_idx;
+        for (auto& c: cells) {
+            group_idx.push_back(c.first);
+        }
+
+        // Every dataset "mech_id.var_id" is a column of the table
+        for (auto& name: dyn_params.dataset_names()) {
+            auto dot = name.find('.');
+            if (dot == std::string::npos) {
+                continue;
+            }
+
+            if (column_ids.find(name) == column_ids.end()) {
+                column_ids[name] = density_overrides_.vars.size();
+                density_overrides_.vars.push_back({name.substr(0, dot), name.substr(dot + 1)});
+                density_overrides_.values.emplace_back(local_gids_.size(), std::numeric_limits<double>::quiet_NaN());
+            }
+            auto& column = density_overrides_.values[column_ids[name]];
+
+            auto values = read_indices<double>(group_idx, [&](unsigned i, unsigned j) {
+                return dyn_params.double_range(name, i, j);
+            });
+            for (unsigned k = 0; k < cells.size(); k++) {
+                column[cells[k].second] = values[k];
+            }
+        }
+    }
+}
+
+void database::build_spike_map() {
+    // (local index, time) of every input spike of the local cells
+    std::vector<std::pair<unsigned, double>> spikes;
+
+    for (auto& sp: spikes_) {
+        auto spike_idx = sp.data.find_group("spikes");
+        if (spike_idx == -1) {
+            throw sonata_exception("Input spikes file doesn't have top level group \"spikes\"");
+        }
+        auto& spike_group = sp.data[spike_idx];
+
+        auto pop_map = nodes_.map();
+        if (pop_map.find(sp.population) == pop_map.end()) {
+            continue;
+        }
+
+        // Local cells of the population: a contiguous block of local_gids_
+        auto pop_id = pop_map.at(sp.population);
+        auto first = std::lower_bound(local_gids_.begin(), local_gids_.end(), nodes_.partitions()[pop_id]);
+        auto last = std::lower_bound(first, local_gids_.end(), nodes_.partitions()[pop_id + 1]);
+        if (first == last) {
+            continue;
+        }
+
+        // One read for the ranges of all local cells
+        unsigned el_first = *first - nodes_.partitions()[pop_id];
+        unsigned el_last = std::min<unsigned>(*(last - 1) - nodes_.partitions()[pop_id] + 1,
+                                              spike_group.dataset_size("gid_to_range"));
+        if (el_first >= el_last) {
+            continue;
+        }
+        auto ranges = spike_group.int_pair_range("gid_to_range", el_first, el_last);
+
+        // (timestamp range, local index) of the local cells with spikes, ordered by position in the file
+        std::vector<std::pair<std::pair<int, int>, unsigned>> reads;
+        for (auto it = first; it != last; it++) {
+            unsigned el = *it - nodes_.partitions()[pop_id];
+            if (el < el_last && ranges[el - el_first].second > ranges[el - el_first].first) {
+                reads.push_back({ranges[el - el_first], unsigned(it - local_gids_.begin())});
+            }
+        }
+        std::sort(reads.begin(), reads.end());
+
+        // Coalesce adjacent ranges into single reads of the timestamps
+        for (unsigned r = 0; r < reads.size();) {
+            unsigned q = r + 1;
+            int end = reads[r].first.second;
+            while (q < reads.size() && reads[q].first.first <= end) {
+                end = std::max(end, reads[q].first.second);
+                q++;
+            }
+
+            int begin = reads[r].first.first;
+            auto times = spike_group.double_range("timestamps", begin, end);
+            for (; r < q; r++) {
+                for (auto t = reads[r].first.first; t < reads[r].first.second; t++) {
+                    spikes.push_back({reads[r].second, times[t - begin]});
+                }
+            }
+        }
+    }
+
+    std::sort(spikes.begin(), spikes.end());
+
+    spike_divs_.assign(local_gids_.size() + 1, 0);
+    spike_times_.clear();
+    spike_times_.reserve(spikes.size());
+    for (auto& s: spikes) {
+        spike_divs_[s.first + 1]++;
+        spike_times_.push_back(s.second);
+    }
+    std::partial_sum(spike_divs_.begin(), spike_divs_.end(), spike_divs_.begin());
+}
+
+// Smallest and largest value of integer dataset `name` over slice `part` of `num_parts` of the dataset
+// Stops early once two different values are found; a missing dataset is reported as non-uniform
+static std::pair<int, int> column_min_max(const h5_wrapper& pop, const std::string& name,
+                                          unsigned part, unsigned num_parts) {
+    int size = pop.dataset_size(name);
+    if (size < 0) {
+        return {std::numeric_limits<int>::min(), std::numeric_limits<int>::max()};
+    }
+
+    std::pair<int, int> min_max = {std::numeric_limits<int>::max(), std::numeric_limits<int>::min()};
+
+    const int chunk = 1 << 20;
+    int begin = (long)size * part / num_parts;
+    int end = (long)size * (part + 1) / num_parts;
+
+    for (int i = begin; i < end && min_max.first >= min_max.second; i += chunk) {
+        for (auto v: pop.int_range(name, i, std::min(end, i + chunk))) {
+            min_max.first = std::min(min_max.first, v);
+            min_max.second = std::max(min_max.second, v);
+        }
+    }
+    return min_max;
+}
+
+void database::build_edge_indices() {
+    for (unsigned i = 0; i < edges_.pop_names().size(); i++) {
+        if (edges_[i].find_group("indicies") != -1) {
+            continue;
+        }
+        auto name = edges_.pop_names()[i];
+        if (!opts_.generate_edge_indices) {
+            throw sonata_exception(pprintf("Edge population {} has no indicies group", name));
+        }
+
+        // Sizes of the source and target node populations, from the edge types
+        auto node_pop_size = [&](const std::string& field) -> unsigned {
+            auto node_pops = nodes_.map();
+            auto col = edge_types_.column_id(field);
+            for (auto id: edge_types_.unique_ids()) {
+                if (id.pop_name() == name && edge_types_.has_field(id, col) && node_pops.count(edge_types_.string_field(id, col))) {
+                    auto p = node_pops[edge_types_.string_field(id, col)];
+                    return pop_partitions_[p + 1] - pop_partitions_[p];
+                }
+            }
+            throw sonata_exception(pprintf("No {} of edge population {} in the edge types", field, name));
+        };
+        auto num_sources = node_pop_size("source_pop_name");
+        auto num_targets = node_pop_size("target_pop_name");
+
+        // Sidecar file, keyed by the identity of the edge file
+        std::string sidecar;
+        if (!opts_.edge_index_cache.empty()) {
+            std::ostringstream path;
+            path << opts_.edge_index_cache << "/" << name << "_" << std::hex << std::setw(16) << std::setfill('0')
+                 << hash_file_identity(edges_.file_name(i), hash_string(name, 0xcbf29ce484222325ull)) << ".h5";
+            sidecar = path.str();
+
+            auto group = read_index_file(sidecar, name);
+#ifdef ARB_MPI_ENABLED
+            // All ranks use the sidecar, or none does
+            if (!min_all(int(group != nullptr), MPI_COMM_WORLD)) {
+                group = nullptr;
+            }
+#endif
+            if (group) {
+                edges_.add_group(i, group);
+                continue;
+            }
+        }
+
+        // Every rank finds the runs of a slice of the edges, then all ranks sort the runs of all edges
+        long num_edges = edges_[i].dataset_size("source_node_id");
+        long first = 0, last = num_edges;
+#ifdef ARB_MPI_ENABLED
+        first = num_edges*rank(MPI_COMM_WORLD)/size(MPI_COMM_WORLD);
+        last = num_edges*(rank(MPI_COMM_WORLD) + 1)/size(MPI_COMM_WORLD);
+#endif
+        unsigned num_threads = opts_.index_threads ? opts_.index_threads : std::max(1u, std::thread::hardware_concurrency());
+
+        auto all_runs = [&](const std::string& column) {
+            auto runs = find_edge_runs(edges_[i].int_range(column, first, last), first, num_threads);
+#ifdef ARB_MPI_ENABLED
+            return gather_all(runs, MPI_COMM_WORLD);
+#else
+            return runs;
+#endif
+        };
+        auto source_to_target = index_edge_runs(all_runs("source_node_id"), num_sources, num_threads);
+        auto target_to_source = index_edge_runs(all_runs("target_node_id"), num_targets, num_threads);
+
+        if (!sidecar.empty()) {
+#ifdef ARB_MPI_ENABLED
+            bool root = rank(MPI_COMM_WORLD) == 0;
+#else
+            bool root = true;
+#endif
+            // Written to a temporary file, renamed once complete so that readers never see a partial file
+            if (root) {
+                write_index_file(sidecar + ".tmp", name, source_to_target, target_to_source);
+                if (std::rename((sidecar + ".tmp").c_str(), sidecar.c_str()) != 0) {
+                    throw sonata_exception(pprintf("Unable to write index file {}", sidecar));
+                }
+            }
+        }
+        edges_.add_group(i, make_index_group(std::move(source_to_target), std::move(target_to_source)));
+    }
+}
+
+void database::build_uniform_nodes() {
+    unsigned part = 0, num_parts = 1;
+#ifdef ARB_MPI_ENABLED
+    part = rank(MPI_COMM_WORLD);
+    num_parts = size(MPI_COMM_WORLD);
+#endif
+
+    uniform_nodes_.assign(nodes_.populations().size(), uniform_node_attributes());
+    for (unsigned p = 0; p < nodes_.populations().size(); p++) {
+        // Every rank scans a slice of the group ids; the type ids are scanned once, by fill_cell_kinds
+        auto group_id = column_min_max(nodes_[p], "node_group_id", part, num_parts);
+#ifdef ARB_MPI_ENABLED
+        group_id = {min_all(group_id.first, MPI_COMM_WORLD), max_all(group_id.second, MPI_COMM_WORLD)};
+#endif
+        uniform_nodes_[p].group_id = {group_id.first == group_id.second, group_id.first};
+    }
+}
+
+void database::build_cell_kinds() {
+    if (image_) {
+        cell_kinds_ = image_->cell_kinds();
+        return;
+    }
+
+    std::vector<std::pair<int, int>> type_id;
+#ifdef ARB_MPI_ENABLED
+    if (opts_.shared_tables) {
+        const auto& comms = node_comms();
+
+        std::shared_ptr<void> owner;
+        MPI_Win win;
+        auto kinds = allocate_node_shared<std::uint8_t>(num_cells(), comms.node, owner, win);
+
+        // Only the node leader reads the node files and writes to the shared window
+        write_node_shared({win}, comms.node, [&] { type_id = fill_cell_kinds(kinds); });
+
+        cell_kinds_ = shared_table<std::uint8_t>(kinds, num_cells(), std::move(owner));
+
+        // The other ranks of the node get the type ids the leader found
+        type_id.resize(nodes_.populations().size(), {std::numeric_limits<int>::max(), std::numeric_limits<int>::min()});
+        for (auto& t: type_id) {
+            t = {min_all(t.first, comms.node), max_all(t.second, comms.node)};
+        }
+    }
+    else
+#endif
+    {
+        std::vector<std::uint8_t> kinds(num_cells());
+        type_id = fill_cell_kinds(kinds.data());
+        cell_kinds_ = shared_table<std::uint8_t>(std::move(kinds));
+    }
+
+    for (unsigned p = 0; p < type_id.size(); p++) {
+        uniform_nodes_[p].type_id = {type_id[p].first == type_id[p].second, type_id[p].first};
+    }
+}
+
+std::vector<std::pair<int, int>> database::fill_cell_kinds(std::uint8_t* kinds) {
+    const int chunk = 1 << 20;
+
+    std::vector<std::pair<int, int>> type_id;
+    for (unsigned p = 0; p < nodes_.populations().size(); p++) {
+        auto pop = nodes_.pop_id(p);
+
+        // Kind of every node type of the population, resolved once per type
+        std::unordered_map<int, std::uint8_t> type_kinds;
+        auto kind_of = [&](int type_tag) {
+            auto it = type_kinds.find(type_tag);
+            if (it == type_kinds.end()) {
+                auto kind = static_cast<std::uint8_t>(node_types_.cell_kind(type_pop_id(type_tag, pop)));
+                it = type_kinds.insert({type_tag, kind}).first;
+            }
+            return it->second;
+        };
+
+        int first = nodes_.partitions()[p];
+        int last = nodes_.partitions()[p + 1];
+
+        std::pair<int, int> min_max = {std::numeric_limits<int>::max(), std::numeric_limits<int>::min()};
+        for (int i = 0; i < last - first; i += chunk) {
+            auto types = nodes_[p].int_range("node_type_id", i, std::min(last - first, i + chunk));
+            for (unsigned j = 0; j < types.size(); j++) {
+                kinds[first + i + j] = kind_of(types[j]);
+                min_max.first = std::min(min_max.first, types[j]);
+                min_max.second = std::max(min_max.second, types[j]);
+            }
+        }
+        type_id.push_back(min_max);
+    }
+    return type_id;
+}
+
+void database::build_uniform_edges() {
+    unsigned part = 0, num_parts = 1;
+#ifdef ARB_MPI_ENABLED
+    part = rank(MPI_COMM_WORLD);
+    num_parts = size(MPI_COMM_WORLD);
+#endif
+
+    const auto& cat = arb::global_default_catalogue();
+
+    uniform_edges_.assign(edges_.populations().size(), uniform_edge_attributes());
+    edge_groups_.assign(edges_.populations().size(), edge_group_cache());
+    for (unsigned p = 0; p < edges_.populations().size(); p++) {
+        auto& u = uniform_edges_[p];
+
+        // Every rank scans a slice of the columns
+        auto group_id = column_min_max(edges_[p], "edge_group_id", part, num_parts);
+        auto type_id = column_min_max(edges_[p], "edge_type_id", part, num_parts);
+#ifdef ARB_MPI_ENABLED
+        group_id = {min_all(group_id.first, MPI_COMM_WORLD), max_all(group_id.second, MPI_COMM_WORLD)};
+        type_id = {min_all(type_id.first, MPI_COMM_WORLD), max_all(type_id.second, MPI_COMM_WORLD)};
+#endif
+        u.group_id = {group_id.first == group_id.second, group_id.first};
+        u.type_id = {type_id.first == type_id.second, type_id.first};
+
+        // Edges have one synapse each unless a group or an edge type of the population has nsyns
+        bool has_nsyns = false;
+        for (int g = 0; g < edges_[p].size(); g++) {
+            has_nsyns |= edges_[p][g].find_dataset("nsyns") != -1;
+        }
+        auto nsyns_col = edge_types_.column_id("nsyns");
+        for (auto id: edge_types_.unique_ids()) {
+            has_nsyns |= id.pop_name() == edges_[p].name() && edge_types_.has_field(id, nsyns_col);
+        }
+        u.const_nsyns = !has_nsyns;
+
+        if (!u.group_id.uniform || !u.type_id.uniform) {
+            continue;
+        }
+
+        // All edges share a group and a type: attributes that are not stored in the group
+        // come from the type, and are the same as those of the first edge
+        arena_scope scope(arena_);
+        auto lgi = edges_[p].find_group(std::to_string(u.group_id.value));
+        auto in_group = [&](const std::string& name) {
+            return lgi != -1 && edges_[p][lgi].find_dataset(name) != -1;
+        };
+
+        if (!in_group("efferent_section_id") && !in_group("efferent_section_pos")) {
+            u.source = source_range(p, {0, 1}).front();
+            u.const_source = true;
+        }
+        if (!in_group("afferent_section_id") && !in_group("afferent_section_pos") && !in_group("model_template")) {
+            auto target = target_range(p, {0, 1}).front();
+            bool params_in_group = false;
+            for (auto& param: cat[synapses_[target.synapse].name()].parameters) {
+                params_in_group |= in_group(param.first);
+            }
+            if (!params_in_group) {
+                u.target = target;
+                u.const_target = true;
+            }
+        }
+        if (!in_group("syn_weight")) {
+            u.weight = weight_range(p, {0, 1}).front();
+            u.const_weight = true;
+        }
+        if (!in_group("delay")) {
+            u.delay = delay_range(p, {0, 1}).front();
+            u.const_delay = true;
+        }
+        if (!in_group("nsyns")) {
+            u.nsyns = nsyns_range(p, {0, 1}).front();
+            u.const_nsyns = true;
+        }
+    }
+}
+
+// Lays out the sources gathered from all ranks in gid order
+// `gids` and `sizes` have `n` entries and describe the consecutive blocks of `sources`
+// `divs` must hold num_cells+1 entries, `out` as many entries as `sources`
+template <typename Loc>
+static void sort_sources_by_gid(const cell_gid_type* gids, const unsigned* sizes, std::size_t n,
+                                const Loc* sources, cell_size_type num_cells,
+                                unsigned* divs, Loc* out) {
+    std::fill(divs, divs + num_cells + 1, 0);
+    for (std::size_t i = 0; i < n; i++) {
+        divs[gids[i] + 1] = sizes[i];
+    }
+    std::partial_sum(divs, divs + num_cells + 1, divs);
+
+    for (std::size_t i = 0; i < n; i++) {
+        std::copy(sources, sources + sizes[i], out + divs[gids[i]]);
+        sources += sizes[i];
+    }
+}
+
+// Gathers the sources of the local cells of all ranks into a table indexed by gid
+// Local cell `gids[i]` has the `sizes[i]` next sources of `sources`
+// The table is kept in node shared memory if `shared` is set
+// `overlap(progress)` runs while the non-blocking gathers of the sources are in flight, and should call
+// progress() regularly; with `shared` it runs before the exchange, which is blocking
+template <typename Loc, typename Overlap>
+static void gather_source_table(const std::vector<cell_gid_type>& gids, std::vector<unsigned> sizes,
+                                std::vector<Loc> sources, cell_size_type num_cells, bool shared,
+                                shared_table<unsigned>& divs_out, shared_table<Loc>& sources_out,
+                                Overlap&& overlap) {
+#ifdef ARB_MPI_ENABLED
+    if (shared) {
+        // The exchange through the shared windows is blocking
+        overlap([] {});
+
+        const auto& comms = node_comms();
+
+        auto glob_source_gids = gather_all_shared(gids, comms);
+        auto glob_source_sizes = gather_all_shared(sizes, comms);
+        auto glob_sources = gather_all_shared(sources, comms);
+
+        std::shared_ptr<void> divs_owner, sources_owner;
+        MPI_Win divs_win, sources_win;
+        auto divs = allocate_node_shared<unsigned>(num_cells + 1, comms.node, divs_owner, divs_win);
+        auto out = allocate_node_shared<Loc>(glob_sources.size(), comms.node, sources_owner, sources_win);
+
+        // Only the node leader writes to the shared windows
+        write_node_shared({divs_win, sources_win}, comms.node, [&] {
+            sort_sources_by_gid(glob_source_gids.data(), glob_source_sizes.data(), glob_source_gids.size(),
+                                glob_sources.data(), num_cells, divs, out);
+        });
+
+        divs_out = shared_table<unsigned>(divs, num_cells + 1, std::move(divs_owner));
+        sources_out = shared_table<Loc>(out, glob_sources.size(), std::move(sources_owner));
+    }
+    else {
+        pending_gather<cell_gid_type> pending_gids(gids, MPI_COMM_WORLD);
+        pending_gather<unsigned> pending_sizes(std::move(sizes), MPI_COMM_WORLD);
+        pending_gather<Loc> pending_sources(std::move(sources), MPI_COMM_WORLD);
+
+        overlap([&] {
+            pending_gids.test();
+            pending_sizes.test();
+            pending_sources.test();
+        });
+
+        auto glob_source_gids = pending_gids.wait();
+        auto glob_source_sizes = pending_sizes.wait();
+        auto glob_sources = pending_sources.wait();
+
+        std::vector<unsigned> divs(num_cells + 1);
+        std::vector<Loc> out(glob_sources.size());
+        sort_sources_by_gid(glob_source_gids.data(), glob_source_sizes.data(), glob_source_gids.size(),
+                            glob_sources.data(), num_cells, divs.data(), out.data());
+
+        divs_out = shared_table<unsigned>(std::move(divs));
+        sources_out = shared_table<Loc>(std::move(out));
+    }
+#else
+    overlap([] {});
+
+    std::vector<unsigned> divs(num_cells + 1);
+    std::vector<Loc> out(sources.size());
+    sort_sources_by_gid(gids.data(), sizes.data(), gids.size(),
+                        sources.data(), num_cells, divs.data(), out.data());
+
+    divs_out = shared_table<unsigned>(std::move(divs));
+    sources_out = shared_table<Loc>(std::move(out));
+#endif
+}
+
+void database::build_source_and_target_maps() {
+    // The sources of the local cells are read first; the targets are then read while the non-blocking
+    // gathers of the source table are in flight, see database_options::overlap_source_exchange
+    // In streaming mode the targets are loaded per cell group by targets_of instead
+    bool streaming = opts_.resident_groups > 0;
+    bool overlap = opts_.overlap_source_exchange;
+    targets_ = target_table();
+    targets_.divs.assign(1, 0);
+    group_targets_.assign(streaming ? group_gids_.size() : 0, target_table());
+    resident_groups_.clear();
+
+    auto build_targets = [&](auto&& progress) {
+        if (streaming) {
+            return;
+        }
+        for (auto gid: local_gids_) {
+            append_targets(gid, targets_);
+            progress();
+        }
+    };
+    auto overlapped_targets = [&](auto&& progress) {
+        if (overlap) {
+            build_targets(progress);
+        }
+    };
 
-    for (auto group: groups) {
-        loc_source_gids.insert(loc_source_gids.end(), group.gids.begin(), group.gids.end());
-        for (auto gid: group.gids) {
-            std::unordered_set<source_type> src_set;
-            std::vector<std::pair<target_type, unsigned>> tgt_vec;
+    precision_ = edge_precision_report();
+    if (image_) {
+        // The sources of all cells are in the image, and the targets are copied from it
+        auto& header = image_->header();
+        precision_.compact_sources = header.compact_sources;
+        precision_.max_position_error = header.max_position_error;
+        precision_.merged_sources = header.merged_sources;
+
+        source_divs_ = image_->source_divs();
+        if (precision_.compact_sources) {
+            compact_source_maps_ = image_->compact_sources();
+        }
+        else {
+            source_maps_ = image_->sources();
+        }
+        build_targets([] {});
+    }
+    else {
+        // Build loc_source_sizes and loc_sources, in local_gids_ order
+        std::vector<unsigned> loc_source_sizes;
+        std::vector<source_type> loc_sources;
+
+        for (auto gid: local_gids_) {
+            arena_scope scope(arena_);
+            arena_vector<source_type> src_vec(arena_);
 
             auto loc_node = localize_cell(gid);
             auto source_edge_pops = edges_of_source(loc_node.pop_id);
-            auto target_edge_pops = edges_of_target(loc_node.pop_id);
 
             for (auto i: source_edge_pops) {
                 auto ind_id = edges_[i].find_group("indicies");
@@ -114,83 +1027,141 @@ void database::build_source_and_target_maps(const std::vector<arb::group_descrip
                 for (auto j = n2r_range.first; j< n2r_range.second; j++) {
                     auto r2e = edges_[i][ind_id][s2t_id].int_pair_at("range_to_edge_id", j);
                     auto src_rng = source_range(i, r2e);
-                    for (auto s: src_rng) {
-                        auto loc = src_set.find(s);
-                        if (loc == src_set.end()) {
-                            src_set.insert(s);
-                        }
-                    }
+                    src_vec.insert(src_vec.end(), src_rng.begin(), src_rng.end());
                 }
             }
 
-            for (auto i: target_edge_pops) {
-                auto ind_id = edges_[i].find_group("indicies");
-                auto t2s_id = edges_[i][ind_id].find_group("target_to_source");
-                auto n2r = edges_[i][ind_id][t2s_id].int_pair_at("node_id_to_ranges", loc_node.el_id);
-                for (auto j = n2r.first; j< n2r.second; j++) {
-                    auto r2e = edges_[i][ind_id][t2s_id].int_pair_at("range_to_edge_id", j);
-
-                    auto tgt_rng = target_range(i, r2e);
-
-                    std::vector<unsigned> edge_rng(r2e.second - r2e.first);
-                    std::iota(edge_rng.begin(), edge_rng.end(), r2e.first);
-
-                    for (unsigned k = 0; k < tgt_rng.size(); k++) {
-                        tgt_vec.push_back(std::make_pair(tgt_rng[k], globalize_edge({i, (cell_gid_type)edge_rng[k]})));
-                    }
-                }
-            }
-
-            // Build loc_sources
-            std::vector<source_type> src_vec(src_set.begin(), src_set.end());
+            // Build loc_sources: the distinct sources of the cell, sorted
             std::sort(src_vec.begin(), src_vec.end(), [](const auto &a, const auto& b) -> bool
             {
                 return std::tie(a.segment, a.position) < std::tie(b.segment, b.position);
             });
+            src_vec.erase(std::unique(src_vec.begin(), src_vec.end()), src_vec.end());
 
             loc_sources.insert(loc_sources.end(), src_vec.begin(), src_vec.end());
             loc_source_sizes.push_back(src_vec.size());
+        }
 
-            // Build target_maps_
-            std::sort(tgt_vec.begin(), tgt_vec.end(), [](const auto &a, const auto& b) -> bool
-            {
-                return a.second < b.second;
-            });
-            target_maps_[gid].insert(target_maps_[gid].end(), tgt_vec.begin(), tgt_vec.end());
+        // Compact the sources if requested, and if every section id fits in 16 bits
+        if (opts_.compact_edges) {
+            unsigned max_segment = 0;
+            for (auto& s: loc_sources) {
+                max_segment = std::max(max_segment, s.segment);
+            }
+#ifdef ARB_MPI_ENABLED
+            max_segment = max_all(max_segment, MPI_COMM_WORLD);
+#endif
+            precision_.compact_sources = max_segment <= std::numeric_limits<std::uint16_t>::max();
+        }
+
+        if (precision_.compact_sources) {
+            // Quantisation keeps the sources of a cell sorted, but can make some of them equal: keep one of each
+            std::vector<compact_location> sources;
+            std::vector<unsigned> sizes;
+            sources.reserve(loc_sources.size());
+
+            auto next = loc_sources.begin();
+            for (auto n: loc_source_sizes) {
+                auto first = sources.size();
+                for (auto it = next; it != next + n; it++) {
+                    sources.emplace_back(it->segment, it->position);
+                    precision_.max_position_error = std::max(precision_.max_position_error,
+                                                             std::abs(sources.back().position_value() - it->position));
+                }
+                auto last = std::unique(sources.begin() + first, sources.end());
+                precision_.merged_sources += sources.end() - last;
+                sources.erase(last, sources.end());
+
+                sizes.push_back(sources.size() - first);
+                next += n;
+            }
+            decltype(loc_sources)().swap(loc_sources);
+
+            gather_source_table(local_gids_, std::move(sizes), std::move(sources), num_cells(), opts_.shared_tables,
+                                source_divs_, compact_source_maps_, overlapped_targets);
+        }
+        else {
+            gather_source_table(local_gids_, std::move(loc_source_sizes), std::move(loc_sources), num_cells(),
+                                opts_.shared_tables, source_divs_, source_maps_, overlapped_targets);
+        }
+        if (!overlap) {
+            build_targets([] {});
         }
     }
 
+    // Compact the targets likewise; in streaming mode the targets loaded later keep their full precision
+    if (opts_.compact_edges && !streaming) {
+        unsigned max_segment = 0;
+        for (auto& t: targets_.maps) {
+            max_segment = std::max(max_segment, t.segment);
+        }
 #ifdef ARB_MPI_ENABLED
-    auto glob_source_gids = gather_all(loc_source_gids, MPI_COMM_WORLD);
-    auto glob_source_sizes = gather_all(loc_source_sizes, MPI_COMM_WORLD);
-    auto glob_sources = gather_all(loc_sources, MPI_COMM_WORLD);
-#else
-    auto glob_source_gids = loc_source_gids;
-    auto glob_source_sizes = loc_source_sizes;
-    auto glob_sources = loc_sources;
+        max_segment = max_all(max_segment, MPI_COMM_WORLD);
 #endif
+        precision_.compact_targets = max_segment <= std::numeric_limits<std::uint16_t>::max();
+    }
 
-    // Build source_maps
-    std::vector<unsigned> glob_source_divs(glob_source_sizes.size() + 1);
-    glob_source_divs[0] = 0;
-    for (unsigned i = 1; i < glob_source_sizes.size() + 1; i++) {
-        glob_source_divs[i] = glob_source_sizes[i-1] + glob_source_divs[i-1];
+    if (precision_.compact_targets) {
+        targets_.compact_maps.reserve(targets_.maps.size());
+        for (auto& t: targets_.maps) {
+            compact_location loc(t.segment, t.position);
+            precision_.max_position_error = std::max(precision_.max_position_error,
+                                                     std::abs(loc.position_value() - t.position));
+            targets_.compact_maps.push_back({loc, t.synapse});
+        }
+        decltype(targets_.maps)().swap(targets_.maps);
+        targets_.compact = true;
     }
 
-    for (unsigned i = 0; i < glob_source_gids.size(); i++) {
-        auto r0 = glob_source_divs[i];
-        auto r1 = glob_source_divs[i + 1];
-        auto sub_v = std::vector<source_type>(glob_sources.begin() + r0, glob_sources.begin() + r1);
+#ifdef ARB_MPI_ENABLED
+    if (opts_.compact_edges) {
+        precision_.max_position_error = max_all(precision_.max_position_error, MPI_COMM_WORLD);
+        // The sources of an image are already counted over all ranks
+        if (!image_) {
+            precision_.merged_sources = sum_all(precision_.merged_sources, MPI_COMM_WORLD);
+        }
+    }
+#endif
+}
 
-        source_maps_[glob_source_gids[i]] = std::move(sub_v);
+// Index of `key` in the sorted sources `first` to `last` of a cell; throws exception if not found
+template <typename Loc, typename Less>
+static unsigned source_index(const Loc* first, const Loc* last, const Loc& key, Less&& less) {
+    auto loc = std::lower_bound(first, last, key, less);
+    if (loc == last || !(*loc == key)) {
+        throw sonata_exception("source maps initialized incorrectly");
     }
+    return loc - first;
 }
 
 void database::get_connections(cell_gid_type gid, std::vector<arb::cell_connection>& conns) {
+    require_build_state();
+
+    if (image_) {
+        auto& cell = image_cells_[gid];
+        conns.reserve(conns.size() + cell.num_incoming);
+        for (auto i = cell.first_incoming; i < cell.first_incoming + cell.num_incoming; i++) {
+            auto& c = image_connections_[i];
+            conns.emplace_back(cell_member_type{c.source_gid, c.source_index},
+                               cell_member_type{gid, c.target_index}, c.weight, c.delay);
+        }
+        return;
+    }
     // Find cell local index in population
     auto loc_node = localize_cell(gid);
     auto edge_to_source = edge_to_source_of_target(loc_node.pop_id);
 
+    // Global edge ids of the targets of the cell, sorted; an edge has one target per synapse
+    auto lid = local_index(gid);
+    auto targets = targets_of(lid);
+    auto first_target = targets.first->edges.begin() + targets.first->divs[targets.second];
+    auto last_target = targets.first->edges.begin() + targets.first->divs[targets.second + 1];
+
+    // Target index of the `i`th target of the cell: the index of its instance if the targets are coalesced
+    auto target_index = [&](unsigned i) {
+        return has_instances() ? targets.first->instances[targets.first->divs[targets.second] + i] : i;
+    };
+
     for (auto i: edge_to_source) {
         auto edge_pop = i.first;
         auto source_pop = i.second;
@@ -200,57 +1171,56 @@ void database::get_connections(cell_gid_type gid, std::vector<arb::cell_connecti
         auto n2r_range = edges_[edge_pop][ind_id][s2t_id].int_pair_at("node_id_to_ranges", loc_node.el_id);
 
         for (auto j = n2r_range.first; j< n2r_range.second; j++) {
+            arena_scope scope(arena_);
+
             auto r2e = edges_[edge_pop][ind_id][s2t_id].int_pair_at("range_to_edge_id", j);
             auto src_rng = source_range(edge_pop, r2e);
-            auto tgt_rng = target_range(edge_pop, r2e);
             auto weights = weight_range(edge_pop, r2e);
             auto delays = delay_range(edge_pop, r2e);
+            auto nsyns = nsyns_range(edge_pop, r2e);
 
             auto src_id = edges_[edge_pop].int_range("source_node_id", r2e.first, r2e.second);
 
-            std::vector<cell_member_type> sources, targets;
+            arena_vector<cell_member_type> sources(arena_);
+            arena_vector<unsigned> targets(arena_);
+            sources.reserve(src_rng.size());
+            targets.reserve(src_rng.size());
 
             for(unsigned s = 0; s < src_rng.size(); s++) {
                 auto source_gid = globalize_cell({source_pop, (cell_gid_type)src_id[s]});
 
-                auto loc = std::lower_bound(source_maps_[source_gid].begin(), source_maps_[source_gid].end(), src_rng[s],
-                                            [](const auto& lhs, const auto& rhs) -> bool
-                                            {
-                                                return std::tie(lhs.segment, lhs.position) <
-                                                       std::tie(rhs.segment, rhs.position);
-                                            });
-
-                if (loc != source_maps_[source_gid].end()) {
-                    if (*loc == src_rng[s]) {
-                        unsigned index = loc - source_maps_[source_gid].begin();
-                        sources.push_back({source_gid, index});
-                    }
-                    else {
-                        throw sonata_exception("source maps initialized incorrectly");
-                    }
+                unsigned index;
+                if (precision_.compact_sources) {
+                    index = source_index(compact_source_maps_.begin() + source_divs_[source_gid],
+                                         compact_source_maps_.begin() + source_divs_[source_gid + 1],
+                                         compact_location(src_rng[s].segment, src_rng[s].position),
+                                         std::less<compact_location>());
                 }
                 else {
-                    throw sonata_exception("source maps initialized incorrectly");
+                    index = source_index(source_maps_.begin() + source_divs_[source_gid],
+                                         source_maps_.begin() + source_divs_[source_gid + 1],
+                                         src_rng[s],
+                                         [](const auto& lhs, const auto& rhs) -> bool
+                                         {
+                                             return std::tie(lhs.segment, lhs.position) <
+                                                    std::tie(rhs.segment, rhs.position);
+                                         });
                 }
+                sources.push_back({source_gid, index});
             }
 
-            unsigned e = 0;
-            for(unsigned t = r2e.first; t < r2e.second; t++, e++) {
-                auto loc = std::lower_bound(target_maps_[gid].begin(), target_maps_[gid].end(),
-                                            std::make_pair(tgt_rng[e], globalize_edge({edge_pop, (cell_gid_type)t})),
-                                            [](const auto& lhs, const auto& rhs) -> bool
-                                            {
-                                                return lhs.second < rhs.second;
-                                            });
+            // Index of the first target of every edge, its synapses are the nsyns targets from there
+            for(unsigned t = r2e.first; t < r2e.second; t++) {
+                auto n = nsyns[t - r2e.first];
+                if (n == 0) {
+                    targets.push_back(0);
+                    continue;
+                }
+                auto edge = globalize_edge({edge_pop, (cell_gid_type)t});
+                auto loc = std::lower_bound(first_target, last_target, edge);
 
-                if (loc != target_maps_[gid].end()) {
-                    if ((*loc).second == globalize_edge({edge_pop, (cell_gid_type)t})) {
-                        unsigned index = loc - target_maps_[gid].begin();
-                        targets.push_back({gid, index});
-                    }
-                    else {
-                        throw sonata_exception("target maps initialized incorrectly");
-                    }
+                if (last_target - loc >= (long)n && *loc == edge && *(loc + n - 1) == edge) {
+                    targets.push_back(loc - first_target);
                 }
                 else {
                     throw sonata_exception("target maps initialized incorrectly");
@@ -258,7 +1228,9 @@ void database::get_connections(cell_gid_type gid, std::vector<arb::cell_connecti
             }
 
             for (unsigned k = 0; k < sources.size(); k++) {
-                conns.emplace_back(sources[k], targets[k], weights[k], delays[k]);
+                for (unsigned n = 0; n < nsyns[k]; n++) {
+                    conns.emplace_back(sources[k], cell_member_type{gid, target_index(targets[k] + n)}, weights[k], delays[k]);
+                }
             }
         }
     }
@@ -267,27 +1239,65 @@ void database::get_connections(cell_gid_type gid, std::vector<arb::cell_connecti
 void database::get_sources_and_targets(cell_gid_type gid,
                                        std::vector<segment_location>& src,
                                        std::vector<std::pair<segment_location, arb::mechanism_desc>>& tgt) {
-    src.reserve(source_maps_[gid].size());
-    for (auto s: source_maps_[gid]) {
-        src.push_back(segment_location(s.segment, s.position));
+    require_build_state();
+    src.reserve(num_sources(gid));
+    for (auto i = source_divs_[gid]; i < source_divs_[gid + 1]; i++) {
+        if (precision_.compact_sources) {
+            auto& s = compact_source_maps_[i];
+            src.push_back(segment_location(s.segment, s.position_value()));
+        }
+        else {
+            src.push_back(segment_location(source_maps_[i].segment, source_maps_[i].position));
+        }
+    }
+
+    auto targets = targets_of(local_index(gid));
+    auto& table = *targets.first;
+    auto first = table.divs[targets.second];
+    auto last = table.divs[targets.second + 1];
+
+    auto add_target = [&](unsigned i) {
+        if (table.compact) {
+            auto& t = table.compact_maps[i];
+            tgt.push_back(std::make_pair(segment_location(t.location.segment, t.location.position_value()),
+                                         synapses_[t.synapse]));
+        }
+        else {
+            auto& t = table.maps[i];
+            tgt.push_back(std::make_pair(segment_location(t.segment, t.position), synapses_[t.synapse]));
+        }
+    };
+
+    if (!has_instances()) {
+        tgt.reserve(last - first);
+        for (auto i = first; i < last; i++) {
+            add_target(i);
+        }
+        return;
     }
 
-    tgt.reserve(target_maps_[gid].size());
-    for (auto t: target_maps_[gid]) {
-        tgt.push_back(std::make_pair(segment_location(t.first.segment, t.first.position), t.first.synapse));
+    // One target per instance, in instance order, described by the first target of the instance
+    arena_scope scope(arena_);
+    auto num_instances = table.instance_divs[targets.second + 1] - table.instance_divs[targets.second];
+    arena_vector<unsigned> first_of(num_instances, 0, arena_);
+    for (auto i = last; i-- > first;) {
+        first_of[table.instances[i]] = i;
+    }
+    tgt.reserve(num_instances);
+    for (auto i: first_of) {
+        add_target(i);
     }
 }
 
 arb::morphology database::get_cell_morphology(cell_gid_type gid) {
-    auto loc_node = localize_cell(gid);
-    auto node_pop_id = loc_node.pop_id;
-    auto node_id = loc_node.el_id;
+    require_build_state();
+    auto lid = local_index(gid);
+    auto node_pop_id = local_nodes_.pop_id[lid];
 
-    auto group_id = nodes_[node_pop_id].int_at("node_group_id", node_id);
-    auto group_idx = nodes_[node_pop_id].int_at("node_group_index", node_id);
+    auto group_id = local_nodes_.group_id[lid];
+    auto group_idx = local_nodes_.group_index[lid];
 
-    auto node_type_tag = nodes_[node_pop_id].int_at("node_type_id", node_id);
-    auto node_pop_name = nodes_[node_pop_id].name();
+    auto node_type_tag = local_nodes_.type_id[lid];
 
     if (nodes_[node_pop_id].find_group(std::to_string(group_id)) != -1) {
         auto lgi = nodes_[node_pop_id].find_group(std::to_string(group_id));
@@ -300,327 +1310,527 @@ arb::morphology database::get_cell_morphology(cell_gid_type gid) {
             return arb::swc_as_morphology(arb::parse_swc_file(f));
         }
     }
-    return node_types_.morph(type_pop_id(node_type_tag, node_pop_name));
+    return node_types_.morph(type_pop_id(node_type_tag, nodes_.pop_id(node_pop_id)));
 }
 
-arb::cell_kind database::get_cell_kind(cell_gid_type gid) {
-    auto loc_node = localize_cell(gid);
-    auto node_pop_id = loc_node.pop_id;
-    auto node_id = loc_node.el_id;
-
-    auto node_type_tag = nodes_[node_pop_id].int_at("node_type_id", node_id);
-    auto node_pop_name = nodes_[node_pop_id].name();
-
-    return node_types_.cell_kind(type_pop_id(node_type_tag, node_pop_name));
+arb::cell_kind database::get_cell_kind(cell_gid_type gid) const {
+    return static_cast<arb::cell_kind>(cell_kinds_[gid]);
 }
 
 std::unordered_map<std::string, std::vector<arb::mechanism_desc>> database::get_density_mechs(cell_gid_type gid) {
-    auto loc_node = localize_cell(gid);
-    auto node_pop_id = loc_node.pop_id;
-    auto node_id = loc_node.el_id;
-
-    auto nodes_grp_id = nodes_[node_pop_id].int_at("node_group_id", node_id);
-    auto nodes_grp_idx = nodes_[node_pop_id].int_at("node_group_index", node_id);
-
-    auto nodes_type_tag = nodes_[node_pop_id].int_at("node_type_id", node_id);
-    auto nodes_pop_name = nodes_[node_pop_id].name();
-
-    auto node_unique_id = type_pop_id(nodes_type_tag, nodes_pop_name);
-
-    auto density_vars = node_types_.dynamic_params(node_unique_id);
-
-    for (auto id: density_vars) {
-        auto gp_id = id.first;
-        for (auto var: id.second) {
-            auto var_id = var.first;
-            auto gp_var_id = gp_id + "." + var_id;
-
-            if (nodes_[node_pop_id].find_group(std::to_string(nodes_grp_id)) != -1) {
-                auto lgi = nodes_[node_pop_id].find_group(std::to_string(nodes_grp_id));
-                auto group = nodes_[node_pop_id][lgi];
-                if (group.find_group("dynamics_params") != -1) {
-                    auto dpi = group.find_group("dynamics_params");
-                    auto dyn_params = group[dpi];
-                    if (dyn_params.find_dataset(gp_var_id) != -1) {
-                        auto value = dyn_params.double_at(gp_var_id, nodes_grp_idx);
-                        density_vars[gp_id][var_id] = value;
-                    }
-                }
-            }
+    require_build_state();
+    auto lid = local_index(gid);
+    auto node_pop_id = local_nodes_.pop_id[lid];
+
+    auto nodes_type_tag = local_nodes_.type_id[lid];
+    auto node_unique_id = type_pop_id(nodes_type_tag, nodes_.pop_id(node_pop_id));
+
+    // Overrides of the cell, from the table built in build_local_maps
+    std::unordered_map<std::string, variable_map> overrides;
+    for (unsigned c = 0; c < density_overrides_.vars.size(); c++) {
+        auto value = density_overrides_.values[c][lid];
+        if (!std::isnan(value)) {
+            overrides[density_overrides_.vars[c].first][density_overrides_.vars[c].second] = value;
         }
     }
-    node_types_.override_density_params(node_unique_id, std::move(density_vars));
-    return node_types_.density_mech_desc(node_unique_id);
+
+    return node_types_.density_mech_desc(node_unique_id, overrides);
 }
 
 std::vector<double> database::get_spikes(cell_gid_type gid) {
-    std::vector<double> spike_times;
+    require_build_state();
+    auto i = local_index(gid);
+    return std::vector<double>(spike_times_.begin() + spike_divs_[i], spike_times_.begin() + spike_divs_[i + 1]);
+};
 
-    auto loc_cell = localize_cell(gid);
+unsigned database::num_sources(cell_gid_type gid) {
+    require_build_state();
+    return source_divs_[gid + 1] - source_divs_[gid];
+}
 
-    for (auto sp: spikes_) {
-        if (nodes_[loc_cell.pop_id].name() != sp.population) {
-            continue;
-        }
+unsigned database::num_targets(cell_gid_type gid) {
+    require_build_state();
+    // Only the cells of this rank have targets in the local maps
+    auto lid = find_local(gid);
+    if (lid == -1) {
+        return 0;
+    }
+    auto targets = targets_of(lid);
+    auto& divs = has_instances() ? targets.first->instance_divs : targets.first->divs;
+    return divs[targets.second + 1] - divs[targets.second];
+}
 
-        auto spike_idx = sp.data.find_group("spikes");
-        if (spike_idx == -1) {
-            throw sonata_exception("Input spikes file doesn't have top level group \"spikes\"");
+void database::append_targets(cell_gid_type gid, target_table& table) {
+    if (image_) {
+        auto& cell = image_cells_[gid];
+        for (auto i = cell.first_incoming; i < cell.first_incoming + cell.num_incoming; i++) {
+            auto t = image_targets_[i];
+            t.synapse = image_synapses_[t.synapse];
+            table.maps.push_back(t);
+            table.edges.push_back(image_target_edges_[i]);
+        }
+        table.divs.push_back(table.maps.size());
+        if (has_instances()) {
+            assign_instances(table);
         }
-        auto range = sp.data[spike_idx].int_pair_at("gid_to_range", loc_cell.el_id);
+        return;
+    }
 
-        auto spk_times = sp.data[spike_idx].double_range("timestamps", range.first, range.second);
+    arena_scope scope(arena_);
+    arena_vector<std::pair<target_type, unsigned>> tgt_vec(arena_);
 
-        spike_times.insert(spike_times.end(), spk_times.begin(), spk_times.end());
+    auto loc_node = localize_cell(gid);
+    for (auto i: edges_of_target(loc_node.pop_id)) {
+        auto ind_id = edges_[i].find_group("indicies");
+        auto t2s_id = edges_[i][ind_id].find_group("target_to_source");
+        auto n2r = edges_[i][ind_id][t2s_id].int_pair_at("node_id_to_ranges", loc_node.el_id);
+        for (auto j = n2r.first; j< n2r.second; j++) {
+            auto r2e = edges_[i][ind_id][t2s_id].int_pair_at("range_to_edge_id", j);
+
+            auto tgt_rng = target_range(i, r2e);
+            auto nsyns = nsyns_range(i, r2e);
+            for (unsigned k = 0; k < tgt_rng.size(); k++) {
+                auto edge = globalize_edge({i, (cell_gid_type)(r2e.first + k)});
+                for (unsigned n = 0; n < nsyns[k]; n++) {
+                    tgt_vec.push_back(std::make_pair(tgt_rng[k], edge));
+                }
+            }
+        }
     }
 
-    std::sort(spike_times.begin(), spike_times.end());
-    return spike_times;
-};
-
-unsigned database::num_sources(cell_gid_type gid) {
-    return source_maps_[gid].size();
+    std::sort(tgt_vec.begin(), tgt_vec.end(), [](const auto &a, const auto& b) -> bool
+    {
+        return a.second < b.second;
+    });
+    for (auto& t: tgt_vec) {
+        table.maps.push_back(t.first);
+        table.edges.push_back(t.second);
+    }
+    table.divs.push_back(table.maps.size());
+    if (has_instances()) {
+        assign_instances(table);
+    }
 }
 
-unsigned database::num_targets(cell_gid_type gid) {
-    return target_maps_[gid].size();
-}
+void database::assign_instances(target_table& table) {
+    if (table.instance_divs.empty()) {
+        table.instance_divs.push_back(0);
+    }
+    auto first = table.divs[table.divs.size() - 2];
+    auto last = table.divs.back();
 
-////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+    auto linear = [&](unsigned synapse) {
+        auto& names = opts_.linear_synapses;
+        return std::find(names.begin(), names.end(), synapses_[synapse].name()) != names.end();
+    };
+    auto key = [&](unsigned i) {
+        auto& t = table.maps[i];
+        return std::make_tuple(t.segment, t.position, t.synapse);
+    };
 
-// Private helper functions
+    // Sorted by target, then by index: every target is merged into the first equal target of its run
+    arena_scope scope(arena_);
+    arena_vector<unsigned> order(arena_), merged_into(last - first, 0, arena_);
+    for (auto i = first; i < last; i++) {
+        order.push_back(i);
+    }
+    std::sort(order.begin(), order.end(), [&](unsigned a, unsigned b) {
+        return std::tuple_cat(key(a), std::make_tuple(a)) < std::tuple_cat(key(b), std::make_tuple(b));
+    });
+    for (unsigned k = 0; k < order.size(); k++) {
+        auto i = order[k];
+        bool merge = opts_.coalesce_synapses && k > 0 && key(order[k - 1]) == key(i) && linear(table.maps[i].synapse);
+        merged_into[i - first] = merge ? merged_into[order[k - 1] - first] : i;
+    }
 
-// Read from HDF5 file/ CSV file depending on where the information is available
+    // Numbered in location order, or in order of first use; either way a target is numbered after the one it is merged into
+    unsigned num_instances = 0;
+    table.instances.resize(last);
+    auto number = [&](unsigned i) {
+        auto j = merged_into[i - first];
+        table.instances[i] = j == i ? num_instances++ : table.instances[j];
+    };
+    if (opts_.order_targets) {
+        for (auto i: order) {
+            number(i);
+        }
+    }
+    else {
+        for (auto i = first; i < last; i++) {
+            number(i);
+        }
+    }
+    table.instance_divs.push_back(table.instance_divs.back() + num_instances);
+}
 
-std::vector<source_type> database::source_range(unsigned edge_pop_id, std::pair<unsigned, unsigned> edge_range) {
-    std::vector<source_type> ret;
+std::pair<const database::target_table*, unsigned> database::targets_of(unsigned lid) {
+    if (opts_.resident_groups == 0) {
+        return {&targets_, lid};
+    }
 
-    // First read edge_group_id and edge_group_index and edge_type
-    auto edges_grp_id = edges_[edge_pop_id].int_range("edge_group_id", edge_range.first, edge_range.second);
-    auto edges_grp_idx = edges_[edge_pop_id].int_range("edge_group_index", edge_range.first, edge_range.second);
-    auto edges_type_tag = edges_[edge_pop_id].int_range("edge_type_id", edge_range.first, edge_range.second);
-    auto edges_pop_name = edges_[edge_pop_id].name();
+    auto g = local_groups_[lid];
+    auto it = std::find(resident_groups_.begin(), resident_groups_.end(), g);
+    if (it == resident_groups_.end()) {
+        load_group_targets(g);
+    }
+    else {
+        resident_groups_.erase(it);
+        resident_groups_.push_back(g);
+    }
+    return {&group_targets_[g], local_rows_[lid]};
+}
 
-    for (unsigned i = 0; i < edges_grp_id.size(); i++) {
-        auto loc_grp_id = edges_grp_id[i];
+void database::load_group_targets(unsigned g) {
+    if (resident_groups_.size() >= opts_.resident_groups) {
+        group_targets_[resident_groups_.front()] = target_table();
+        resident_groups_.erase(resident_groups_.begin());
+    }
 
-        int source_branch;
-        double source_pos;
+    auto& table = group_targets_[g];
+    table.divs.assign(1, 0);
+    for (auto gid: group_gids_[g]) {
+        append_targets(gid, table);
+    }
+    resident_groups_.push_back(g);
+}
 
-        bool found_source_branch = false;
-        bool found_source_pos = false;
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
 
-        // if the edges are in groups, for each edge find the group, if it exists
-        if (edges_[edge_pop_id].find_group(std::to_string(loc_grp_id)) != -1) {
-            auto lgi = edges_[edge_pop_id].find_group(std::to_string(loc_grp_id));
-            auto group = edges_[edge_pop_id][lgi];
-            auto loc_grp_idx = edges_grp_idx[i];
+// Private helper functions
 
-            if (group.find_dataset("efferent_section_id") != -1) {
-                source_branch = group.int_at("efferent_section_id", loc_grp_idx);
-                found_source_branch = true;
-            }
-            if (group.find_dataset("efferent_section_pos") != -1) {
-                source_pos = group.double_at("efferent_section_pos", loc_grp_idx);
-                found_source_pos = true;
-            }
-        }
+// Read from HDF5 file/ CSV file depending on where the information is available
 
-        // name and index of edge_type_id
-        auto e_fields = edge_types_.fields(type_pop_id(edges_type_tag[i], edges_pop_name));
+const h5_wrapper* database::edge_group(unsigned edge_pop_id, int group_id) {
+    auto& groups = edge_groups_[edge_pop_id].groups;
+    auto it = groups.find(group_id);
+    if (it == groups.end()) {
+        it = groups.try_emplace(group_id, edges_[edge_pop_id].find_group(std::to_string(group_id))).first;
+    }
+    return it->second == -1 ? nullptr : &edges_[edge_pop_id][it->second];
+}
 
-        if (!found_source_branch) {
-            source_branch = std::atoi(e_fields["efferent_section_id"].c_str());
-        }
-        if (!found_source_pos) {
-            source_pos = std::atof(e_fields["efferent_section_pos"].c_str());
+// Calls f(first, last) for every run [first, last) of consecutive edges with the same group and type
+template <typename F>
+static void for_each_edge_run(const std::vector<int>& group_ids, const std::vector<int>& type_ids, F&& f) {
+    unsigned last;
+    for (unsigned first = 0; first < group_ids.size(); first = last) {
+        last = first + 1;
+        while (last < group_ids.size() && group_ids[last] == group_ids[first] && type_ids[last] == type_ids[first]) {
+            last++;
         }
+        f(first, last);
+    }
+}
 
-        ret.emplace_back((unsigned)source_branch, source_pos);
+// Values of a dataset of `group` at the group indices index[first, last), read by `read(i, j)` as the
+// values between i and j; nearby indices are coalesced into range reads by read_indices
+template <typename Read>
+static auto gather_group_range(const h5_wrapper& group, const std::vector<int>& index, unsigned first, unsigned last,
+                               Read&& read) -> decltype(read(0u, 0u)) {
+    using values_type = decltype(read(0u, 0u));
+
+    // Distinct indices of the run, sorted; usually they already are
+    std::vector<unsigned> ids;
+    ids.reserve(last - first);
+    for (unsigned i = first; i < last; i++) {
+        if (index[i] < 0) {
+            throw sonata_exception(pprintf("Negative edge_group_index in edge group {}", group.name()));
+        }
+        ids.push_back(index[i]);
+    }
+    bool in_order = true;
+    for (unsigned i = 1; i < ids.size() && in_order; i++) {
+        in_order = ids[i - 1] < ids[i];
+    }
+    if (in_order) {
+        return read_indices<typename values_type::value_type>(ids, read);
+    }
+    std::sort(ids.begin(), ids.end());
+    ids.erase(std::unique(ids.begin(), ids.end()), ids.end());
+    auto values = read_indices<typename values_type::value_type>(ids, read);
+
+    values_type ret;
+    ret.reserve(last - first);
+    for (unsigned i = first; i < last; i++) {
+        ret.push_back(values[std::lower_bound(ids.begin(), ids.end(), (unsigned)index[i]) - ids.begin()]);
     }
     return ret;
 }
 
-std::vector<target_type> database::target_range(unsigned edge_pop_id, std::pair<unsigned, unsigned> edge_range) {
-    std::vector<target_type> ret;
-
-    // First read edge_group_id and edge_group_index and edge_type
-    auto edges_grp_id = edges_[edge_pop_id].int_range("edge_group_id", edge_range.first, edge_range.second);
-    auto edges_grp_idx = edges_[edge_pop_id].int_range("edge_group_index", edge_range.first, edge_range.second);
-    auto edges_type_tag = edges_[edge_pop_id].int_range("edge_type_id", edge_range.first, edge_range.second);
-    auto edges_pop_name = edges_[edge_pop_id].name();
+static std::vector<int> group_ints(const h5_wrapper& group, const std::string& name,
+                                   const std::vector<int>& index, unsigned first, unsigned last) {
+    return gather_group_range(group, index, first, last,
+                              [&](unsigned i, unsigned j) { return group.int_range(name, i, j); });
+}
 
-    auto cat = arb::global_default_catalogue();
+static std::vector<double> group_doubles(const h5_wrapper& group, const std::string& name,
+                                         const std::vector<int>& index, unsigned first, unsigned last) {
+    return gather_group_range(group, index, first, last,
+                              [&](unsigned i, unsigned j) { return group.double_range(name, i, j); });
+}
 
-    for (unsigned i = 0; i < edges_grp_id.size(); i++) {
-        auto loc_grp_id = edges_grp_id[i];
+// The range functions below work on runs of edges with the same group and type: the group and the
+// defaults of the type are resolved once per run, and the datasets of the group are read with range reads
+// of the nearby group indices of the run
 
-        int target_branch;
-        double target_pos;
-        std::string synapse;
+arena_vector<source_type> database::source_range(unsigned edge_pop_id, std::pair<unsigned, unsigned> edge_range) {
+    if (uniform_edges_[edge_pop_id].const_source) {
+        return arena_vector<source_type>(edge_range.second - edge_range.first, uniform_edges_[edge_pop_id].source, arena_);
+    }
 
-        bool found_target_branch = false;
-        bool found_target_pos = false;
-        bool found_synapse = false;
+    arena_vector<source_type> ret(arena_);
+    ret.reserve(edge_range.second - edge_range.first);
 
-        // if the edges are in groups, for each edge find the group, if it exists
-        if (edges_[edge_pop_id].find_group(std::to_string(loc_grp_id)) != -1) {
-            auto lgi = edges_[edge_pop_id].find_group(std::to_string(loc_grp_id));
-            auto group = edges_[edge_pop_id][lgi];
-            auto loc_grp_idx = edges_grp_idx[i];
+    // First read edge_group_id and edge_group_index and edge_type
+    auto edges_grp_id = column_range(edges_[edge_pop_id], "edge_group_id", uniform_edges_[edge_pop_id].group_id, edge_range);
+    auto edges_grp_idx = edges_[edge_pop_id].int_range("edge_group_index", edge_range.first, edge_range.second);
+    auto edges_type_tag = column_range(edges_[edge_pop_id], "edge_type_id", uniform_edges_[edge_pop_id].type_id, edge_range);
+    auto edges_pop = edges_.pop_id(edge_pop_id);
+    auto branch_col = edge_types_.column_id("efferent_section_id");
+    auto pos_col = edge_types_.column_id("efferent_section_pos");
+
+    for_each_edge_run(edges_grp_id, edges_type_tag, [&](unsigned first, unsigned last) {
+        auto group = edge_group(edge_pop_id, edges_grp_id[first]);
+        type_pop_id type(edges_type_tag[first], edges_pop);
+
+        // Stored in the group, otherwise the defaults of the edge type
+        std::vector<int> branches;
+        std::vector<double> positions;
+
+        if (group && group->find_dataset("efferent_section_id") != -1) {
+            branches = group_ints(*group, "efferent_section_id", edges_grp_idx, first, last);
+        } else {
+            branches.assign(last - first, edge_types_.has_field(type, branch_col) ? (int)edge_types_.double_field(type, branch_col) : 0);
+        }
+        if (group && group->find_dataset("efferent_section_pos") != -1) {
+            positions = group_doubles(*group, "efferent_section_pos", edges_grp_idx, first, last);
+        } else {
+            positions.assign(last - first, edge_types_.has_field(type, pos_col) ? edge_types_.double_field(type, pos_col) : 0);
+        }
 
-            if (group.find_dataset("afferent_section_id") != -1) {
-                target_branch = group.int_at("afferent_section_id", loc_grp_idx);
-                found_target_branch = true;
-            }
-            if (group.find_dataset("afferent_section_pos") != -1) {
-                target_pos = group.double_at("afferent_section_pos", loc_grp_idx);
-                found_target_pos = true;
-            }
-            if (group.find_dataset("model_template") != -1) {
-                synapse = group.string_at("model_template", loc_grp_idx);
-                found_synapse = true;
-            }
+        for (unsigned i = 0; i < last - first; i++) {
+            ret.emplace_back((unsigned)branches[i], positions[i]);
         }
+    });
+    return ret;
+}
 
-        // name and index of edge_type_id
-        auto e_fields = edge_types_.fields(type_pop_id(edges_type_tag[i], edges_pop_name));
+arena_vector<target_type> database::target_range(unsigned edge_pop_id, std::pair<unsigned, unsigned> edge_range) {
+    if (uniform_edges_[edge_pop_id].const_target) {
+        return arena_vector<target_type>(edge_range.second - edge_range.first, uniform_edges_[edge_pop_id].target, arena_);
+    }
 
-        if (!found_target_branch) {
-            if (e_fields.find("afferent_section_id") != e_fields.end()) {
-                target_branch = std::atoi(e_fields["afferent_section_id"].c_str());
-            } else {
-                throw sonata_exception("Afferent Section ID missing");
-            }
-        }
-        if (!found_target_pos) {
-            if (e_fields.find("afferent_section_pos") != e_fields.end()) {
-                target_pos = std::atof(e_fields["afferent_section_pos"].c_str());
-            } else {
-                throw sonata_exception("Afferent Section pos missing");
-            }
+    arena_vector<target_type> ret(arena_);
+    ret.reserve(edge_range.second - edge_range.first);
+
+    // First read edge_group_id and edge_group_index and edge_type
+    auto edges_grp_id = column_range(edges_[edge_pop_id], "edge_group_id", uniform_edges_[edge_pop_id].group_id, edge_range);
+    auto edges_grp_idx = edges_[edge_pop_id].int_range("edge_group_index", edge_range.first, edge_range.second);
+    auto edges_type_tag = column_range(edges_[edge_pop_id], "edge_type_id", uniform_edges_[edge_pop_id].type_id, edge_range);
+    auto edges_pop = edges_.pop_id(edge_pop_id);
+    auto branch_col = edge_types_.column_id("afferent_section_id");
+    auto pos_col = edge_types_.column_id("afferent_section_pos");
+    auto template_col = edge_types_.column_id("model_template");
+
+    const auto& cat = arb::global_default_catalogue();
+    auto& synapse_ids = edge_groups_[edge_pop_id].synapses;
+
+    for_each_edge_run(edges_grp_id, edges_type_tag, [&](unsigned first, unsigned last) {
+        auto group = edge_group(edge_pop_id, edges_grp_id[first]);
+        auto stored = [&](const std::string& name) { return group && group->find_dataset(name) != -1; };
+        type_pop_id type(edges_type_tag[first], edges_pop);
+
+        // Location, stored in the group, otherwise the default of the edge type
+        std::vector<int> branches;
+        std::vector<double> positions;
+
+        if (stored("afferent_section_id")) {
+            branches = group_ints(*group, "afferent_section_id", edges_grp_idx, first, last);
+        } else if (edge_types_.has_field(type, branch_col)) {
+            branches.assign(last - first, edge_types_.double_field(type, branch_col));
+        } else {
+            throw sonata_exception("Afferent Section ID missing");
         }
-        if (!found_synapse) {
-            if (e_fields.find("model_template") != e_fields.end()) {
-                synapse = e_fields["model_template"];
-            } else {
-                throw sonata_exception("Model Template missing");
-            }
+        if (stored("afferent_section_pos")) {
+            positions = group_doubles(*group, "afferent_section_pos", edges_grp_idx, first, last);
+        } else if (edge_types_.has_field(type, pos_col)) {
+            positions.assign(last - first, edge_types_.double_field(type, pos_col));
+        } else {
+            throw sonata_exception("Afferent Section pos missing");
         }
 
-        // After finding the synapse, set the parameters
-        std::unordered_map<std::string, double> syn_params;
-
-        arb::mechanism_desc syn(synapse);
-        auto mech = edge_types_.point_mech_desc(type_pop_id(edges_type_tag[i], edges_pop_name));
-
-        if (mech.name() == synapse) {
-            for (auto v: mech.values()) {
-                syn.set(v.first, v.second);
+        // Synapses: unless the group holds the model template or parameters of the synapse, all the edges
+        // of the run have the synapse of their group and type, which is only described and interned once
+        std::vector<unsigned> synapses;
+        auto key = edge_group_key(edges_grp_id[first], edges_type_tag[first]);
+        auto cached = synapse_ids.find(key);
+
+        if (cached != synapse_ids.end()) {
+            synapses.assign(last - first, cached->second);
+        } else {
+            auto mech = edge_types_.point_mech_desc(type);
+
+            // Parameters stored in the group, read over the run when first needed
+            std::unordered_map<std::string, std::vector<double>> group_params;
+
+            // Synapse `name` of edge `i`: the parameters of the edge type if it has the same mechanism,
+            // overridden by those stored in the group
+            auto describe = [&](const std::string& name, unsigned i) {
+                arb::mechanism_desc syn(name);
+                if (mech.name() == name) {
+                    for (auto& v: mech.values()) {
+                        syn.set(v.first, v.second);
+                    }
+                }
+                const auto& info = cat[name];
+                for (auto& p: info.parameters) {
+                    if (stored(p.first)) {
+                        auto values = group_params.find(p.first);
+                        if (values == group_params.end()) {
+                            values = group_params.emplace(p.first, group_doubles(*group, p.first, edges_grp_idx, first, last)).first;
+                        }
+                        syn.set(p.first, values->second[i - first]);
+                    }
+                }
+                return syn;
             };
-        }
 
-        for (auto p: cat[synapse].parameters) {
-            if (edges_[edge_pop_id].find_group(std::to_string(loc_grp_id)) != -1) {
-                auto lgi = edges_[edge_pop_id].find_group(std::to_string(loc_grp_id));
-                auto group = edges_[edge_pop_id][lgi];
-                auto loc_grp_idx = edges_grp_idx[i];
-                if (group.find_dataset(p.first) != -1) {
-                    syn_params[p.first] = group.double_at(p.first, loc_grp_idx);
+            if (stored("model_template")) {
+                for (unsigned i = first; i < last; i++) {
+                    synapses.push_back(synapses_.intern(describe(group->string_at("model_template", edges_grp_idx[i]), i)));
+                }
+            } else {
+                if (!edge_types_.has_field(type, template_col)) {
+                    throw sonata_exception("Model Template missing");
+                }
+                auto synapse = edge_types_.string_field(type, template_col);
+
+                const auto& info = cat[synapse];
+                bool per_edge = false;
+                for (auto& p: info.parameters) {
+                    per_edge |= stored(p.first);
+                }
+                if (per_edge) {
+                    for (unsigned i = first; i < last; i++) {
+                        synapses.push_back(synapses_.intern(describe(synapse, i)));
+                    }
+                } else {
+                    auto id = synapses_.intern(describe(synapse, first));
+                    synapse_ids.try_emplace(key, id);
+                    synapses.assign(last - first, id);
                 }
             }
         }
 
-        for (auto p: syn_params) {
-            syn.set(p.first, p.second);
+        for (unsigned i = 0; i < last - first; i++) {
+            ret.emplace_back((unsigned)branches[i], positions[i], synapses[i]);
         }
-
-        ret.emplace_back((unsigned)target_branch, target_pos, syn);
-    }
+    });
     return ret;
 }
 
-std::vector<double> database::weight_range(unsigned edge_pop_id, std::pair<unsigned, unsigned> edge_range) {
-    std::vector<double> ret;
+arena_vector<double> database::weight_range(unsigned edge_pop_id, std::pair<unsigned, unsigned> edge_range) {
+    if (uniform_edges_[edge_pop_id].const_weight) {
+        return arena_vector<double>(edge_range.second - edge_range.first, uniform_edges_[edge_pop_id].weight, arena_);
+    }
+
+    arena_vector<double> ret(arena_);
+    ret.reserve(edge_range.second - edge_range.first);
 
     // First read edge_group_id and edge_group_index and edge_type
-    auto edges_grp_id = edges_[edge_pop_id].int_range("edge_group_id", edge_range.first, edge_range.second);
+    auto edges_grp_id = column_range(edges_[edge_pop_id], "edge_group_id", uniform_edges_[edge_pop_id].group_id, edge_range);
     auto edges_grp_idx = edges_[edge_pop_id].int_range("edge_group_index", edge_range.first, edge_range.second);
-    auto edges_type_tag = edges_[edge_pop_id].int_range("edge_type_id", edge_range.first, edge_range.second);
-    auto edges_pop_name = edges_[edge_pop_id].name();
-
-    for (unsigned i = 0; i < edges_grp_id.size(); i++) {
-        auto loc_grp_id = edges_grp_id[i];
+    auto edges_type_tag = column_range(edges_[edge_pop_id], "edge_type_id", uniform_edges_[edge_pop_id].type_id, edge_range);
+    auto edges_pop = edges_.pop_id(edge_pop_id);
+    auto weight_col = edge_types_.column_id("syn_weight");
 
-        double weight;
-        bool found_weight = false;
+    for_each_edge_run(edges_grp_id, edges_type_tag, [&](unsigned first, unsigned last) {
+        auto group = edge_group(edge_pop_id, edges_grp_id[first]);
 
-        // if the edges are in groups, for each edge find the group, if it exists
-        if (edges_[edge_pop_id].find_group(std::to_string(loc_grp_id)) != -1) {
-            auto lgi = edges_[edge_pop_id].find_group(std::to_string(loc_grp_id));
-            auto group = edges_[edge_pop_id][lgi];
-            auto loc_grp_idx = edges_grp_idx[i];
-
-            if (group.find_dataset("syn_weight") != -1) {
-                weight = group.double_at("syn_weight", loc_grp_idx);
-                found_weight = true;
-            }
+        if (group && group->find_dataset("syn_weight") != -1) {
+            auto weights = group_doubles(*group, "syn_weight", edges_grp_idx, first, last);
+            ret.insert(ret.end(), weights.begin(), weights.end());
+            return;
         }
 
-        // name and index of edge_type_id
-        auto e_fields = edge_types_.fields(type_pop_id(edges_type_tag[i], edges_pop_name));
-
-        if (!found_weight) {
-            if (e_fields.find("syn_weight") != e_fields.end()) {
-                weight = std::atof(e_fields["syn_weight"].c_str());
-            } else {
-                throw sonata_exception("Synapse weight missing");
-            }
+        // Default of the edge type
+        type_pop_id type(edges_type_tag[first], edges_pop);
+        if (!edge_types_.has_field(type, weight_col)) {
+            throw sonata_exception("Synapse weight missing");
         }
-        ret.emplace_back(weight);
-    }
+        ret.insert(ret.end(), last - first, edge_types_.double_field(type, weight_col));
+    });
     return ret;
 }
 
-std::vector<double> database::delay_range(unsigned edge_pop_id, std::pair<unsigned, unsigned> edge_range) {
-    std::vector<double> ret;
+arena_vector<double> database::delay_range(unsigned edge_pop_id, std::pair<unsigned, unsigned> edge_range) {
+    if (uniform_edges_[edge_pop_id].const_delay) {
+        return arena_vector<double>(edge_range.second - edge_range.first, uniform_edges_[edge_pop_id].delay, arena_);
+    }
+
+    arena_vector<double> ret(arena_);
+    ret.reserve(edge_range.second - edge_range.first);
 
     // First read edge_group_id and edge_group_index and edge_type
-    auto edges_grp_id = edges_[edge_pop_id].int_range("edge_group_id", edge_range.first, edge_range.second);
+    auto edges_grp_id = column_range(edges_[edge_pop_id], "edge_group_id", uniform_edges_[edge_pop_id].group_id, edge_range);
     auto edges_grp_idx = edges_[edge_pop_id].int_range("edge_group_index", edge_range.first, edge_range.second);
-    auto edges_type_tag = edges_[edge_pop_id].int_range("edge_type_id", edge_range.first, edge_range.second);
-    auto edges_pop_name = edges_[edge_pop_id].name();
-
-    for (unsigned i = 0; i < edges_grp_id.size(); i++) {
-        auto loc_grp_id = edges_grp_id[i];
+    auto edges_type_tag = column_range(edges_[edge_pop_id], "edge_type_id", uniform_edges_[edge_pop_id].type_id, edge_range);
+    auto edges_pop = edges_.pop_id(edge_pop_id);
+    auto delay_col = edge_types_.column_id("delay");
 
-        double delay;
-        bool found_delay = false;
+    for_each_edge_run(edges_grp_id, edges_type_tag, [&](unsigned first, unsigned last) {
+        auto group = edge_group(edge_pop_id, edges_grp_id[first]);
 
-        // if the edges are in groups, for each edge find the group, if it exists
-        if (edges_[edge_pop_id].find_group(std::to_string(loc_grp_id)) != -1) {
-            auto lgi = edges_[edge_pop_id].find_group(std::to_string(loc_grp_id));
-            auto group = edges_[edge_pop_id][lgi];
-            auto loc_grp_idx = edges_grp_idx[i];
+        if (group && group->find_dataset("delay") != -1) {
+            auto delays = group_doubles(*group, "delay", edges_grp_idx, first, last);
+            ret.insert(ret.end(), delays.begin(), delays.end());
+            return;
+        }
 
-            if (group.find_dataset("delay") != -1) {
-                delay = group.double_at("delay", loc_grp_idx);
-                found_delay = true;
-            }
+        // Default of the edge type
+        type_pop_id type(edges_type_tag[first], edges_pop);
+        if (!edge_types_.has_field(type, delay_col)) {
+            throw sonata_exception("Synapse delay missing");
         }
+        ret.insert(ret.end(), last - first, edge_types_.double_field(type, delay_col));
+    });
+    return ret;
+}
 
-        // name and index of edge_type_id
-        auto e_fields = edge_types_.fields(type_pop_id(edges_type_tag[i], edges_pop_name));
+arena_vector<unsigned> database::nsyns_range(unsigned edge_pop_id, std::pair<unsigned, unsigned> edge_range) {
+    if (uniform_edges_[edge_pop_id].const_nsyns) {
+        return arena_vector<unsigned>(edge_range.second - edge_range.first, uniform_edges_[edge_pop_id].nsyns, arena_);
+    }
 
-        if (!found_delay) {
+    arena_vector<unsigned> ret(arena_);
+    ret.reserve(edge_range.second - edge_range.first);
 
-            if (e_fields.find("delay") != e_fields.end()) {
-                delay = std::atof(e_fields["delay"].c_str());
-            } else {
-                throw sonata_exception("Synapse delay missing");
+    // First read edge_group_id and edge_group_index and edge_type
+    auto edges_grp_id = column_range(edges_[edge_pop_id], "edge_group_id", uniform_edges_[edge_pop_id].group_id, edge_range);
+    auto edges_grp_idx = edges_[edge_pop_id].int_range("edge_group_index", edge_range.first, edge_range.second);
+    auto edges_type_tag = column_range(edges_[edge_pop_id], "edge_type_id", uniform_edges_[edge_pop_id].type_id, edge_range);
+    auto edges_pop = edges_.pop_id(edge_pop_id);
+    auto nsyns_col = edge_types_.column_id("nsyns");
+
+    for_each_edge_run(edges_grp_id, edges_type_tag, [&](unsigned first, unsigned last) {
+        auto group = edge_group(edge_pop_id, edges_grp_id[first]);
+
+        // Stored in the group, otherwise the default of the edge type, or 1
+        std::vector<int> nsyns;
+        if (group && group->find_dataset("nsyns") != -1) {
+            nsyns = group_ints(*group, "nsyns", edges_grp_idx, first, last);
+        } else {
+            type_pop_id type(edges_type_tag[first], edges_pop);
+            nsyns.assign(last - first, edge_types_.has_field(type, nsyns_col) ? (int)edge_types_.double_field(type, nsyns_col) : 1);
+        }
+
+        for (unsigned i = 0; i < last - first; i++) {
+            if (nsyns[i] < 0) {
+                throw sonata_exception(pprintf("Edge {} of population {} has a negative nsyns",
+                                               edge_range.first + first + i, edges_[edge_pop_id].name()));
             }
+            ret.emplace_back(nsyns[i]);
         }
-        ret.emplace_back(delay);
-    }
+    });
     return ret;
 }
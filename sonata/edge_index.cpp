@@ -0,0 +1,223 @@
+#include <arbor/common_types.hpp>
+#include <arbor/cable_cell.hpp>
+
+#include <algorithm>
+#include <cstdio>
+#include <thread>
+
+#include <unistd.h>
+
+#include "include/sonata_exceptions.hpp"
+#include "include/procedural_circuit.hpp"
+#include "include/edge_index.hpp"
+
+// Runs `f(t)` for every t < num_threads, on num_threads threads; `f` must not throw
+template <typename F>
+static void parallel_for(unsigned num_threads, F&& f) {
+    std::vector<std::thread> threads;
+    for (unsigned t = 1; t < num_threads; t++) {
+        threads.emplace_back([&f, t] { f(t); });
+    }
+    f(0);
+    for (auto& t: threads) {
+        t.join();
+    }
+}
+
+// Threads used for `n` elements: enough elements per thread to pay for starting it
+static unsigned threads_for(std::size_t n, unsigned num_threads) {
+    const std::size_t min_per_thread = 1 << 16;
+    return std::max(1u, (unsigned)std::min<std::size_t>(num_threads, n/min_per_thread));
+}
+
+std::vector<edge_run> find_edge_runs(const std::vector<int>& ids, int first, unsigned num_threads) {
+    auto n = ids.size();
+    num_threads = threads_for(n, num_threads);
+
+    std::vector<std::vector<edge_run>> chunks(num_threads);
+    parallel_for(num_threads, [&](unsigned t) {
+        auto& runs = chunks[t];
+        for (auto i = n*t/num_threads; i < n*(t + 1)/num_threads; i++) {
+            int edge = first + (int)i;
+            if (runs.empty() || runs.back().node != ids[i]) {
+                runs.push_back({ids[i], edge, edge + 1});
+            }
+            else {
+                runs.back().last++;
+            }
+        }
+    });
+
+    // Join the runs cut by the chunk boundaries
+    std::vector<edge_run> runs;
+    for (auto& c: chunks) {
+        auto it = c.begin();
+        if (it != c.end() && !runs.empty() && runs.back().node == it->node) {
+            runs.back().last = it->last;
+            it++;
+        }
+        runs.insert(runs.end(), it, c.end());
+    }
+    return runs;
+}
+
+// One pass of a stable LSD radix sort of `in` into `out`, on the 16 bits of the node ids from `shift`
+// Every thread counts the digits of a chunk, then scatters the chunk at its offsets
+static void radix_pass(const std::vector<edge_run>& in, std::vector<edge_run>& out, unsigned shift, unsigned num_threads) {
+    const unsigned radix = 1 << 16;
+    auto n = in.size();
+
+    std::vector<std::vector<std::size_t>> offsets(num_threads, std::vector<std::size_t>(radix, 0));
+    parallel_for(num_threads, [&](unsigned t) {
+        for (auto i = n*t/num_threads; i < n*(t + 1)/num_threads; i++) {
+            offsets[t][(in[i].node >> shift) & (radix - 1)]++;
+        }
+    });
+
+    // Digit major, thread minor: the runs of a digit keep the order of the chunks
+    std::size_t offset = 0;
+    for (unsigned d = 0; d < radix; d++) {
+        for (unsigned t = 0; t < num_threads; t++) {
+            auto count = offsets[t][d];
+            offsets[t][d] = offset;
+            offset += count;
+        }
+    }
+
+    parallel_for(num_threads, [&](unsigned t) {
+        auto& o = offsets[t];
+        for (auto i = n*t/num_threads; i < n*(t + 1)/num_threads; i++) {
+            out[o[(in[i].node >> shift) & (radix - 1)]++] = in[i];
+        }
+    });
+}
+
+edge_index index_edge_runs(std::vector<edge_run> runs, unsigned num_nodes, unsigned num_threads) {
+    for (auto& r: runs) {
+        if (r.node < 0 || (unsigned)r.node >= num_nodes) {
+            throw sonata_exception(pprintf("Edge {} has node id {}, out of range of a population of {} nodes",
+                                           r.first, r.node, num_nodes));
+        }
+    }
+
+    num_threads = threads_for(runs.size(), num_threads);
+    std::vector<edge_run> buffer(runs.size());
+    for (unsigned shift = 0; shift < 32 && (num_nodes - 1) >> shift; shift += 16) {
+        radix_pass(runs, buffer, shift, num_threads);
+        std::swap(runs, buffer);
+    }
+    decltype(buffer)().swap(buffer);
+
+    edge_index index;
+    index.node_id_to_ranges.reserve(num_nodes);
+    auto r = runs.begin();
+    for (unsigned node = 0; node < num_nodes; node++) {
+        int first = index.range_to_edge_id.size();
+        for (; r != runs.end() && (unsigned)r->node == node; r++) {
+            if ((int)index.range_to_edge_id.size() > first && index.range_to_edge_id.back().second == r->first) {
+                index.range_to_edge_id.back().second = r->last;
+            }
+            else {
+                index.range_to_edge_id.emplace_back(r->first, r->last);
+            }
+        }
+        index.node_id_to_ranges.emplace_back(first, (int)index.range_to_edge_id.size());
+    }
+    return index;
+}
+
+static std::shared_ptr<h5_group> make_index_subgroup(std::string name, edge_index index) {
+    auto n2r = std::make_shared<std::vector<std::pair<int, int>>>(std::move(index.node_id_to_ranges));
+    auto r2e = std::make_shared<std::vector<std::pair<int, int>>>(std::move(index.range_to_edge_id));
+
+    std::vector<std::shared_ptr<storage_dataset>> datasets = {
+        generated_dataset::pairs("node_id_to_ranges", n2r->size(), [n2r](unsigned i) { return (*n2r)[i]; }),
+        generated_dataset::pairs("range_to_edge_id", r2e->size(), [r2e](unsigned i) { return (*r2e)[i]; })
+    };
+    return std::make_shared<h5_group>(std::move(name), std::vector<std::shared_ptr<h5_group>>(), std::move(datasets));
+}
+
+std::shared_ptr<h5_group> make_index_group(edge_index source_to_target, edge_index target_to_source) {
+    std::vector<std::shared_ptr<h5_group>> groups = {
+        make_index_subgroup("source_to_target", std::move(source_to_target)),
+        make_index_subgroup("target_to_source", std::move(target_to_source))
+    };
+    return std::make_shared<h5_group>("indicies", std::move(groups), std::vector<std::shared_ptr<storage_dataset>>());
+}
+
+// Writes `pairs` as an int dataset of dimensions pairs.size() x 2
+static bool write_pairs(hid_t group, const std::string& name, const std::vector<std::pair<int, int>>& pairs) {
+    std::vector<int> data;
+    data.reserve(2*pairs.size());
+    for (auto& p: pairs) {
+        data.push_back(p.first);
+        data.push_back(p.second);
+    }
+
+    hsize_t dims[2] = {pairs.size(), 2};
+    auto space = H5Screate_simple(2, dims, NULL);
+    auto dset = H5Dcreate(group, name.c_str(), H5T_NATIVE_INT, space, H5P_DEFAULT, H5P_DEFAULT, H5P_DEFAULT);
+    auto status = dset < 0 ? -1 : H5Dwrite(dset, H5T_NATIVE_INT, H5S_ALL, H5S_ALL, H5P_DEFAULT, data.data());
+
+    if (dset >= 0) H5Dclose(dset);
+    H5Sclose(space);
+    return status >= 0;
+}
+
+void write_index_file(const std::string& path, const std::string& population,
+                      const edge_index& source_to_target, const edge_index& target_to_source) {
+    auto file = H5Fcreate(path.c_str(), H5F_ACC_TRUNC, H5P_DEFAULT, H5P_DEFAULT);
+    if (file < 0) {
+        throw sonata_exception(pprintf("Unable to create index file {}", path));
+    }
+
+    bool ok = true;
+    auto pop = H5Gcreate(file, population.c_str(), H5P_DEFAULT, H5P_DEFAULT, H5P_DEFAULT);
+    auto ind = H5Gcreate(pop, "indicies", H5P_DEFAULT, H5P_DEFAULT, H5P_DEFAULT);
+    for (auto& g: {std::make_pair("source_to_target", &source_to_target),
+                   std::make_pair("target_to_source", &target_to_source)}) {
+        auto sub = H5Gcreate(ind, g.first, H5P_DEFAULT, H5P_DEFAULT, H5P_DEFAULT);
+        ok = ok && sub >= 0 &&
+             write_pairs(sub, "node_id_to_ranges", g.second->node_id_to_ranges) &&
+             write_pairs(sub, "range_to_edge_id", g.second->range_to_edge_id);
+        H5Gclose(sub);
+    }
+    H5Gclose(ind);
+    H5Gclose(pop);
+    ok = H5Fclose(file) >= 0 && ok;
+
+    if (!ok) {
+        std::remove(path.c_str());
+        throw sonata_exception(pprintf("Unable to write index file {}", path));
+    }
+}
+
+std::shared_ptr<h5_group> read_index_file(const std::string& path, const std::string& population) {
+    if (access(path.c_str(), R_OK) != 0) {
+        return nullptr;
+    }
+
+    h5_file file(path);
+    h5_wrapper top(file.top_group_);
+    auto pop_id = top.find_group(population);
+    if (pop_id == -1 || top[pop_id].find_group("indicies") == -1) {
+        return nullptr;
+    }
+    auto& ind = top[pop_id][top[pop_id].find_group("indicies")];
+    if (ind.find_group("source_to_target") == -1 || ind.find_group("target_to_source") == -1) {
+        return nullptr;
+    }
+
+    auto read = [&](const std::string& name) {
+        auto& g = ind[ind.find_group(name)];
+        auto read_pairs = [&](const std::string& dset) {
+            auto n = g.dataset_size(dset);
+            return n > 0 ? g.int_pair_range(dset, 0, n) : std::vector<std::pair<int, int>>();
+        };
+        edge_index index;
+        index.node_id_to_ranges = read_pairs("node_id_to_ranges");
+        index.range_to_edge_id = read_pairs("range_to_edge_id");
+        return index;
+    };
+    return make_index_group(read("source_to_target"), read("target_to_source"));
+}
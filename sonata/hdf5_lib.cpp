@@ -35,7 +35,7 @@ int h5_dataset::size() {
     return size_;
 }
 
-auto h5_dataset::int_at(const int i) {
+int h5_dataset::int_at(const int i) {
     const hsize_t idx = (hsize_t)i;
 
     // Output
@@ -71,7 +71,7 @@ auto h5_dataset::int_at(const int i) {
     return r;
 }
 
-auto h5_dataset::double_at(const int i) {
+double h5_dataset::double_at(const int i) {
     const hsize_t idx = (hsize_t)i;
 
     // Output
@@ -106,7 +106,7 @@ auto h5_dataset::double_at(const int i) {
     return r;
 }
 
-auto h5_dataset::string_at(const int i) {
+int h5_dataset::string_at(const int i) {
     const hsize_t idx = (hsize_t)i;
 
     // Output
@@ -141,14 +141,15 @@ auto h5_dataset::string_at(const int i) {
     return r;
 }
 
-auto h5_dataset::int_range(const int i, const int j) {
+std::vector<int> h5_dataset::int_range(const int i, const int j) {
     hsize_t offset = i;
     hsize_t count = j-i;
     hsize_t stride = 1;
     hsize_t  block = 1;
     hsize_t dimsm = count;
 
-    int rdata[count];
+    // Read straight into the output: ranges can be large, keep them off the stack
+    std::vector<int> out(count);
 
     auto id_ = H5Dopen(parent_id_, name_.c_str(), H5P_DEFAULT);
     hid_t dspace = H5Dget_space(id_);
@@ -156,7 +157,7 @@ auto h5_dataset::int_range(const int i, const int j) {
     hid_t out_mem = H5Screate_simple(1, &dimsm, NULL);
 
     H5Sselect_hyperslab(dspace, H5S_SELECT_SET, &offset, &stride, &count, &block);
-    auto status = H5Dread(id_, H5T_NATIVE_INT, out_mem, dspace, H5P_DEFAULT, rdata);
+    auto status = H5Dread(id_, H5T_NATIVE_INT, out_mem, dspace, H5P_DEFAULT, out.data());
 
     H5Sclose(dspace);
     H5Sclose(out_mem);
@@ -166,19 +167,18 @@ auto h5_dataset::int_range(const int i, const int j) {
         throw sonata_dataset_exception(name_, (unsigned)i, (unsigned)j);
     }
 
-    std::vector<int> out(rdata, rdata + count);
-
     return out;
 }
 
-auto h5_dataset::double_range(const int i, const int j) {
+std::vector<double> h5_dataset::double_range(const int i, const int j) {
     hsize_t offset = i;
     hsize_t count = j-i;
     hsize_t stride = 1;
     hsize_t  block = 1;
     hsize_t dimsm = count;
 
-    double rdata[count];
+    // Read straight into the output: ranges can be large, keep them off the stack
+    std::vector<double> out(count);
 
     auto id_ = H5Dopen(parent_id_, name_.c_str(), H5P_DEFAULT);
     hid_t dspace = H5Dget_space(id_);
@@ -187,7 +187,7 @@ auto h5_dataset::double_range(const int i, const int j) {
 
     H5Sselect_hyperslab(dspace, H5S_SELECT_SET, &offset, &stride, &count, &block);
 
-    auto status = H5Dread(id_, H5T_NATIVE_DOUBLE, out_mem, dspace, H5P_DEFAULT, rdata);
+    auto status = H5Dread(id_, H5T_NATIVE_DOUBLE, out_mem, dspace, H5P_DEFAULT, out.data());
 
     H5Sclose(dspace);
     H5Sclose(out_mem);
@@ -197,12 +197,10 @@ auto h5_dataset::double_range(const int i, const int j) {
         throw sonata_dataset_exception(name_, (unsigned)i, (unsigned)j);
     }
 
-    std::vector<double> out(rdata, rdata + count);
-
     return out;
 }
 
-auto h5_dataset::int_pair_at(const int i) {
+std::pair<int, int> h5_dataset::int_pair_at(const int i) {
     const hsize_t idx_0[2] = {(hsize_t)i, (hsize_t)0};
 
     // Output
@@ -242,7 +240,38 @@ auto h5_dataset::int_pair_at(const int i) {
     return std::make_pair(out_0, out_1);
 }
 
-auto h5_dataset::int_1d() {
+std::vector<std::pair<int, int>> h5_dataset::int_pair_range(const int i, const int j) {
+    hsize_t offset[2] = {(hsize_t)i, 0};
+    hsize_t count[2] = {(hsize_t)(j-i), 2};
+    hsize_t dimsm[2] = {(hsize_t)(j-i), 2};
+
+    std::vector<int> rdata(2*(j-i));
+
+    auto id_ = H5Dopen(parent_id_, name_.c_str(), H5P_DEFAULT);
+    hid_t dspace = H5Dget_space(id_);
+
+    hid_t out_mem = H5Screate_simple(2, dimsm, NULL);
+
+    H5Sselect_hyperslab(dspace, H5S_SELECT_SET, offset, NULL, count, NULL);
+    auto status = H5Dread(id_, H5T_NATIVE_INT, out_mem, dspace, H5P_DEFAULT, rdata.data());
+
+    H5Sclose(dspace);
+    H5Sclose(out_mem);
+    H5Dclose(id_);
+
+    if (status < 0) {
+        throw sonata_dataset_exception(name_, (unsigned)i, (unsigned)j);
+    }
+
+    std::vector<std::pair<int, int>> out(j-i);
+    for (unsigned k = 0; k < out.size(); k++) {
+        out[k] = std::make_pair(rdata[2*k], rdata[2*k+1]);
+    }
+
+    return out;
+}
+
+std::vector<int> h5_dataset::int_1d() {
     int out_a[size_];
     auto id_ = H5Dopen(parent_id_, name_.c_str(), H5P_DEFAULT);
 
@@ -259,7 +288,7 @@ auto h5_dataset::int_1d() {
     return out;
 }
 
-auto h5_dataset::int_2d() {
+std::vector<std::pair<int, int>> h5_dataset::int_2d() {
     int out_a[size_][2];
     auto id_ = H5Dopen(parent_id_, name_.c_str(), H5P_DEFAULT);
 
@@ -281,27 +310,33 @@ auto h5_dataset::int_2d() {
 
 ///h5_group methods
 
-h5_group::h5_group(hid_t parent, std::string name): parent_id_(parent), name_(name), group_h_(parent_id_, name_) {
+h5_group::h5_group(hid_t parent, std::string name):
+        parent_id_(parent), name_(name), group_h_(new group_handle(parent_id_, name_)) {
 
     hsize_t nobj;
-    H5Gget_num_objs(group_h_.id, &nobj);
+    H5Gget_num_objs(group_h_->id, &nobj);
 
     char memb_name[MAX_NAME];
 
     groups_.reserve(nobj);
 
     for (unsigned i = 0; i < nobj; i++) {
-        H5Gget_objname_by_idx(group_h_.id, (hsize_t)i, memb_name, (size_t)MAX_NAME);
-        hid_t otype = H5Gget_objtype_by_idx(group_h_.id, (size_t)i);
+        H5Gget_objname_by_idx(group_h_->id, (hsize_t)i, memb_name, (size_t)MAX_NAME);
+        hid_t otype = H5Gget_objtype_by_idx(group_h_->id, (size_t)i);
         if (otype == H5G_GROUP) {
-            groups_.emplace_back(std::make_shared<h5_group>(group_h_.id, memb_name));
+            groups_.emplace_back(std::make_shared<h5_group>(group_h_->id, memb_name));
         }
         else if (otype == H5G_DATASET) {
-            datasets_.emplace_back(std::make_shared<h5_dataset>(group_h_.id, memb_name));
+            datasets_.emplace_back(std::make_shared<h5_dataset>(group_h_->id, memb_name));
         }
     }
 }
 
+h5_group::h5_group(std::string name,
+                   std::vector<std::shared_ptr<h5_group>> groups,
+                   std::vector<std::shared_ptr<storage_dataset>> datasets):
+        groups_(std::move(groups)), datasets_(std::move(datasets)), parent_id_(-1), name_(name) {}
+
 std::string h5_group::name() {
     return name_;
 }
@@ -367,7 +402,7 @@ h5_wrapper::h5_wrapper(const std::shared_ptr<h5_group>& g): ptr_(g) {
     }
 }
 
-int h5_wrapper::size() {
+int h5_wrapper::size() const {
     return members_.size();
 }
 
@@ -385,6 +420,14 @@ int h5_wrapper::find_dataset(std::string name) const {
     return -1;
 }
 
+std::vector<std::string> h5_wrapper::dataset_names() const {
+    std::vector<std::string> names;
+    for (auto& d: ptr_->datasets_) {
+        names.push_back(d->name());
+    }
+    return names;
+}
+
 int h5_wrapper::dataset_size(std::string name) const {
     if (dset_map_.find(name) != dset_map_.end()) {
         return ptr_->datasets_.at(dset_map_.at(name))->size();
@@ -415,6 +458,9 @@ std::string h5_wrapper::string_at(std::string name, unsigned i) const {
 
 std::vector<int> h5_wrapper::int_range(std::string name, unsigned i, unsigned j) const {
     if (find_dataset(name)!= -1) {
+        if (j <= i) {
+            return {};
+        }
         if (j - i > 1) {
             return ptr_->datasets_.at(dset_map_.at(name))->int_range(i, j);
         } else {
@@ -438,6 +484,13 @@ std::pair<int, int> h5_wrapper::int_pair_at(std::string name, unsigned i) const
     throw sonata_dataset_exception(name);
 }
 
+std::vector<std::pair<int, int>> h5_wrapper::int_pair_range(std::string name, unsigned i, unsigned j) const {
+    if (find_dataset(name)!= -1) {
+        return ptr_->datasets_.at(dset_map_.at(name))->int_pair_range(i, j);
+    }
+    throw sonata_dataset_exception(name);
+}
+
 std::vector<int> h5_wrapper::int_1d(std::string name) const {
     if (find_dataset(name)!= -1) {
         return ptr_->datasets_.at(dset_map_.at(name))->int_1d();
@@ -463,10 +516,13 @@ std::string h5_wrapper::name() const {
     return ptr_->name();
 }
 
+const std::shared_ptr<h5_group>& h5_wrapper::group() const {
+    return ptr_;
+}
+
 ///h5_record methods
 
 h5_record::h5_record(const std::vector<std::shared_ptr<h5_file>>& files) : files_(files) {
-    unsigned idx = 0;
     partition_.push_back(0);
     for (auto f: files) {
         if (f->top_group_->groups_.size() != 1) {
@@ -474,25 +530,36 @@ h5_record::h5_record(const std::vector<std::shared_ptr<h5_file>>& files) : files
         }
 
         for (auto g: f->top_group_->groups_.front()->groups_) {
-            pop_names_.emplace_back(g->name());
-            map_[g->name()] = idx++;
-            populations_.emplace_back(g);
+            add_population(g, f->name());
         }
+    }
+}
 
-        for (auto &p: f->top_group_->groups_.front()->groups_) {
-            for (auto &d: p->datasets_) {
-                if (d->name().find("type_id") != std::string::npos) {
-                    num_elements_ += d->size();
-                    partition_.push_back(num_elements_);
-                }
-            }
+h5_record::h5_record(const std::vector<std::shared_ptr<h5_group>>& populations) {
+    partition_.push_back(0);
+    for (auto g: populations) {
+        add_population(g, "");
+    }
+}
+
+void h5_record::add_population(const std::shared_ptr<h5_group>& g, const std::string& file) {
+    pop_names_.emplace_back(g->name());
+    pop_files_.push_back(file);
+    pop_ids_.push_back(population_names::intern(g->name()));
+    map_[g->name()] = populations_.size();
+    populations_.emplace_back(g);
+
+    for (auto &d: g->datasets_) {
+        if (d->name().find("type_id") != std::string::npos) {
+            num_elements_ += d->size();
+            partition_.push_back(num_elements_);
         }
     }
 }
 
-bool h5_record::verify_edges() {
+bool h5_record::verify_edges(bool require_indices) {
     for (auto& p: populations()) {
-        if (p.find_group("indicies") == -1) {
+        if (require_indices && p.find_group("indicies") == -1) {
             throw sonata_exception("indicies group must be available in all edge population groups ");
         }
         if (p.find_dataset("edge_type_id") == -1) {
@@ -546,3 +613,26 @@ std::unordered_map<std::string, unsigned> h5_record::map() const {
 std::vector<std::string> h5_record::pop_names() const {
     return pop_names_;
 }
+
+std::vector<std::string> h5_record::file_names() const {
+    std::vector<std::string> names;
+    for (auto& f: files_) {
+        names.push_back(f->name());
+    }
+    return names;
+}
+
+std::string h5_record::file_name(unsigned i) const {
+    return pop_files_[i];
+}
+
+void h5_record::add_group(unsigned i, const std::shared_ptr<h5_group>& group) {
+    auto pop = populations_[i].group();
+    auto groups = pop->groups_;
+    groups.push_back(group);
+    populations_[i] = h5_wrapper(std::make_shared<h5_group>(pop->name(), std::move(groups), pop->datasets_));
+}
+
+unsigned h5_record::pop_id(unsigned i) const {
+    return pop_ids_[i];
+}
@@ -0,0 +1,127 @@
+#pragma once
+
+#include <algorithm>
+#include <cstddef>
+#include <memory>
+#include <vector>
+
+/// Monotonic memory arena for short-lived temporaries
+/// Memory is handed out from a list of blocks by bumping an offset, and is only given back by
+/// rewinding the arena to an earlier mark, see arena_scope. Blocks are kept across rewinds, so
+/// once warmed up the arena no longer allocates. Not thread-safe
+class monotonic_arena {
+public:
+    // Position of the arena, to rewind to
+    struct mark {
+        std::size_t block;
+        std::size_t offset;
+    };
+
+    explicit monotonic_arena(std::size_t block_size = 1 << 16): block_size_(block_size) {}
+
+    monotonic_arena(const monotonic_arena&) = delete;
+    monotonic_arena& operator=(const monotonic_arena&) = delete;
+
+    void* allocate(std::size_t n, std::size_t align) {
+        while (current_ < blocks_.size()) {
+            auto& b = blocks_[current_];
+            auto offset = (offset_ + align - 1) / align * align;
+            if (offset + n <= b.size) {
+                offset_ = offset + n;
+                return b.data.get() + offset;
+            }
+            current_++;
+            offset_ = 0;
+        }
+
+        // Out of blocks: add one large enough for `n`, blocks are aligned for any type
+        auto size = std::max(block_size_, n);
+        blocks_.push_back({std::unique_ptr<char[]>(new char[size]), size});
+        current_ = blocks_.size() - 1;
+        offset_ = n;
+        return blocks_.back().data.get();
+    }
+
+    mark position() const {
+        return {current_, offset_};
+    }
+
+    // Frees everything allocated since `m` was taken
+    void rewind(mark m) {
+        current_ = m.block;
+        offset_ = m.offset;
+    }
+
+    // Total size of the blocks
+    std::size_t capacity() const {
+        std::size_t n = 0;
+        for (auto& b: blocks_) {
+            n += b.size;
+        }
+        return n;
+    }
+
+    // Frees the blocks
+    void release() {
+        blocks_.clear();
+        current_ = 0;
+        offset_ = 0;
+    }
+
+private:
+    struct block {
+        std::unique_ptr<char[]> data;
+        std::size_t size;
+    };
+
+    std::size_t block_size_;
+    std::vector<block> blocks_;
+    std::size_t current_ = 0;
+    std::size_t offset_ = 0;
+};
+
+/// Rewinds `arena` on destruction to its position on construction
+/// Containers using the arena must be destroyed before the scope, so declare the scope first
+class arena_scope {
+public:
+    explicit arena_scope(monotonic_arena& arena): arena_(arena), mark_(arena.position()) {}
+    ~arena_scope() { arena_.rewind(mark_); }
+
+    arena_scope(const arena_scope&) = delete;
+    arena_scope& operator=(const arena_scope&) = delete;
+
+private:
+    monotonic_arena& arena_;
+    monotonic_arena::mark mark_;
+};
+
+/// Allocator handing out memory from a monotonic_arena; deallocation is a no-op
+template <typename T>
+struct arena_allocator {
+    using value_type = T;
+
+    arena_allocator(monotonic_arena& arena): arena(&arena) {}
+
+    template <typename U>
+    arena_allocator(const arena_allocator<U>& other): arena(other.arena) {}
+
+    T* allocate(std::size_t n) {
+        return static_cast<T*>(arena->allocate(n*sizeof(T), alignof(T)));
+    }
+    void deallocate(T*, std::size_t) {}
+
+    monotonic_arena* arena;
+};
+
+template <typename T, typename U>
+bool operator==(const arena_allocator<T>& lhs, const arena_allocator<U>& rhs) {
+    return lhs.arena == rhs.arena;
+}
+
+template <typename T, typename U>
+bool operator!=(const arena_allocator<T>& lhs, const arena_allocator<U>& rhs) {
+    return lhs.arena != rhs.arena;
+}
+
+template <typename T>
+using arena_vector = std::vector<T, arena_allocator<T>>;
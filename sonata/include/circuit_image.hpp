@@ -0,0 +1,132 @@
+#pragma once
+
+#include <arbor/common_types.hpp>
+#include <arbor/cable_cell.hpp>
+
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "csv_lib.hpp"
+#include "common_structs.hpp"
+#include "shared_table.hpp"
+
+/// Compiled circuit image: binary file holding the resolved network of a circuit, see database_options::circuit_cache
+/// Everything in the image is indexed by gid, so an image can be used with any domain decomposition.
+/// The inputs (spikes and current clamps) are not part of the image.
+///
+/// Layout, every section 64 byte aligned, in the order of image_layout:
+///   image_header
+///   cell_kinds     uint8_t[num_cells]             arb::cell_kind of every cell
+///   cells          image_cell[num_cells]          node attributes and incoming edges of every cell
+///   source_divs    unsigned[num_cells + 1]        sources of every cell, as in database::source_divs_
+///   sources        source_type[num_sources], or compact_location[num_sources] if compact_sources is set
+///   targets        target_type[num_incoming]      target of every incoming edge, synapse ids index `synapses`
+///   target_edges   unsigned[num_incoming]         global edge id of every incoming edge
+///   connections    image_connection[num_incoming] connection of every incoming edge
+///   synapses       char[synapse_bytes]            synapse descriptions, one per line, see write_synapses
+/// The incoming edges of a cell are contiguous, sorted by global edge id.
+/// Images are only valid on the platform that wrote them: the data is stored in native byte order and layout.
+
+// Bump on every change of the layout
+constexpr std::uint32_t circuit_image_version = 1;
+
+struct image_header {
+    char magic[8];
+    std::uint32_t version;
+    std::uint32_t compact_sources;
+    std::uint64_t key;
+    std::uint64_t num_cells;
+    std::uint64_t num_sources;
+    std::uint64_t num_incoming;
+    std::uint64_t num_synapses;
+    std::uint64_t synapse_bytes;
+
+    // Precision of the compacted sources, see edge_precision_report
+    double max_position_error;
+    std::uint64_t merged_sources;
+};
+
+// Node attributes of a cell, and its incoming edges: num_incoming entries from first_incoming
+struct image_cell {
+    std::uint32_t pop_id;
+    std::int32_t type_id;
+    std::int32_t group_id;
+    std::int32_t group_index;
+    std::uint64_t first_incoming;
+    std::uint64_t num_incoming;
+};
+
+// arb::cell_connection of an incoming edge, the destination is the cell itself
+struct image_connection {
+    std::uint32_t source_gid;
+    std::uint32_t source_index;
+    std::uint32_t target_index;
+    float weight;
+    float delay;
+};
+
+// Byte offsets of the sections of an image
+struct image_layout {
+    std::uint64_t cell_kinds;
+    std::uint64_t cells;
+    std::uint64_t source_divs;
+    std::uint64_t sources;
+    std::uint64_t targets;
+    std::uint64_t target_edges;
+    std::uint64_t connections;
+    std::uint64_t synapses;
+    std::uint64_t size;
+
+    image_layout(const image_header& h);
+};
+
+// Header of an image of the circuit with key `key`, with the counts zeroed
+image_header make_image_header(std::uint64_t key);
+
+// Serialises the descriptions of `synapses` as lines of "name param=value ...", and parses them back
+std::string write_synapses(const synapse_table& synapses);
+std::vector<arb::mechanism_desc> read_synapses(const char* data, std::size_t size);
+
+/// Read-only mapping of an image file
+/// The tables returned by the accessors keep the mapping alive
+class circuit_image {
+public:
+    // Maps the image at `path`; returns null if there is no file, or if it is not a valid image
+    // of version circuit_image_version with key `key` and `num_cells` cells
+    static std::shared_ptr<circuit_image> open(const std::string& path, std::uint64_t key, std::uint64_t num_cells);
+
+    const image_header& header() const { return *header_; }
+
+    shared_table<std::uint8_t> cell_kinds() const { return section<std::uint8_t>(layout_.cell_kinds, header_->num_cells); }
+    shared_table<image_cell> cells() const { return section<image_cell>(layout_.cells, header_->num_cells); }
+    shared_table<unsigned> source_divs() const { return section<unsigned>(layout_.source_divs, header_->num_cells + 1); }
+    shared_table<source_type> sources() const { return section<source_type>(layout_.sources, header_->num_sources); }
+    shared_table<compact_location> compact_sources() const {
+        return section<compact_location>(layout_.sources, header_->num_sources);
+    }
+    shared_table<target_type> targets() const { return section<target_type>(layout_.targets, header_->num_incoming); }
+    shared_table<unsigned> target_edges() const { return section<unsigned>(layout_.target_edges, header_->num_incoming); }
+    shared_table<image_connection> connections() const {
+        return section<image_connection>(layout_.connections, header_->num_incoming);
+    }
+    std::vector<arb::mechanism_desc> synapses() const {
+        return read_synapses(base_ + layout_.synapses, header_->synapse_bytes);
+    }
+
+private:
+    circuit_image(std::shared_ptr<void> mapping, const char* base, const image_header* header):
+        mapping_(std::move(mapping)), base_(base), header_(header), layout_(*header) {}
+
+    template <typename T>
+    shared_table<T> section(std::uint64_t offset, std::uint64_t n) const {
+        return shared_table<T>(reinterpret_cast<const T*>(base_ + offset), n, mapping_);
+    }
+
+    // Unmaps the file with the last reference
+    std::shared_ptr<void> mapping_;
+    const char* base_;
+    const image_header* header_;
+    image_layout layout_;
+};
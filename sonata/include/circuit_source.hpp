@@ -0,0 +1,75 @@
+#pragma once
+
+#include <arbor/cable_cell.hpp>
+
+#include <cstdint>
+#include <vector>
+
+#include "hdf5_lib.hpp"
+#include "csv_lib.hpp"
+#include "common_structs.hpp"
+
+/// Storage backend of a circuit: everything a database is built from
+/// The node and edge populations follow the SONATA layout whatever the storage, see storage_dataset
+class circuit_source {
+public:
+    virtual ~circuit_source() {}
+
+    // Node and edge populations
+    virtual h5_record nodes() const = 0;
+    virtual h5_record edges() const = 0;
+
+    // Node and edge type tables
+    virtual csv_node_record node_types() const = 0;
+    virtual csv_edge_record edge_types() const = 0;
+
+    // Inputs
+    virtual std::vector<spike_info> spikes() const = 0;
+    virtual std::vector<current_clamp_info> current_clamps() const = 0;
+
+    // Hash of everything but the inputs: circuits with the same hash have the same network
+    // Keys the compiled images of the circuit, see database_options::circuit_cache
+    virtual std::uint64_t content_hash() const = 0;
+};
+
+// Helpers of content_hash: hash `seed` combined with a string, and with the contents of the file at `path`
+// Paths that are not readable files, such as "NULL" in the type tables, are hashed as strings
+std::uint64_t hash_string(const std::string& s, std::uint64_t seed);
+std::uint64_t hash_file_contents(const std::string& path, std::uint64_t seed);
+
+// Helper of content_hash for HDF5 files: hash `seed` combined with the path, size and modification time of the file
+// at `path`; hashing the contents would cost as much as reading the network
+std::uint64_t hash_file_identity(const std::string& path, std::uint64_t seed);
+
+/// Circuit read from SONATA HDF5 and CSV files
+class sonata_file_circuit: public circuit_source {
+public:
+    sonata_file_circuit(h5_record nodes,
+                        h5_record edges,
+                        csv_node_record node_types,
+                        csv_edge_record edge_types,
+                        std::vector<spike_info> spikes,
+                        std::vector<current_clamp_info> current_clamps):
+        nodes_(std::move(nodes)), edges_(std::move(edges)),
+        node_types_(std::move(node_types)), edge_types_(std::move(edge_types)),
+        spikes_(std::move(spikes)), current_clamps_(std::move(current_clamps)) {}
+
+    h5_record nodes() const override { return nodes_; }
+    h5_record edges() const override { return edges_; }
+    csv_node_record node_types() const override { return node_types_; }
+    csv_edge_record edge_types() const override { return edge_types_; }
+    std::vector<spike_info> spikes() const override { return spikes_; }
+    std::vector<current_clamp_info> current_clamps() const override { return current_clamps_; }
+
+    // Hashes the path, size and modification time of the HDF5 files, the type tables,
+    // and the contents of the component files they refer to
+    std::uint64_t content_hash() const override;
+
+private:
+    h5_record nodes_;
+    h5_record edges_;
+    csv_node_record node_types_;
+    csv_edge_record edge_types_;
+    std::vector<spike_info> spikes_;
+    std::vector<current_clamp_info> current_clamps_;
+};
@@ -4,9 +4,15 @@
 #include <arbor/cable_cell.hpp>
 #include <arbor/simple_sampler.hpp>
 
+#include "flat_hash_map.hpp"
 #include "hdf5_lib.hpp"
 
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
 #include <string>
+#include <tuple>
+#include <vector>
 
 using arb::cell_gid_type;
 using arb::cell_lid_type;
@@ -14,6 +20,64 @@ using arb::cell_size_type;
 using arb::cell_member_type;
 using arb::segment_location;
 
+struct database_options {
+    // Keep read-only global tables in MPI-3 shared windows, one copy per node
+    bool shared_tables = false;
+
+    // Keep the source and target locations of the connectivity in 32 bits: 16-bit section ids and
+    // positions quantised to 1/65535 of the section. Only used if every section id fits in 16 bits
+    // In streaming mode (resident_groups > 0) only the sources are compacted, see edge_precision_report
+    bool compact_edges = false;
+
+    // Streaming mode if non-zero: the targets of the local cells are loaded per cell group when arbor
+    // first asks for them, and at most `resident_groups` groups are kept in memory
+    // The targets loaded per group keep their full precision, even with compact_edges
+    unsigned resident_groups = 0;
+
+    // Read the targets of the local cells while the source table is exchanged. Only that pass is overlapped:
+    // the sources are read before the exchange starts, and the non-blocking gathers of the source table
+    // (MPI_Iallgatherv) are in flight during the target pass. The exchange is blocking with shared_tables,
+    // and there is no target pass to overlap in streaming mode
+    bool overlap_source_exchange = true;
+
+    // Directory of the compiled circuit images, see circuit_image.hpp; disabled if empty
+    // The network is read from the image of the circuit if there is one, otherwise the image is written
+    // once the network is built. Must be shared by all ranks; only used for databases built from a circuit_source
+    std::string circuit_cache;
+
+    // Generate the indicies group of the edge populations that lack it when the database is built, see edge_index.hpp
+    // Every rank reads a slice of the node ids of the edges, and `index_threads` threads per rank sort them
+    // (0 for one per hardware thread). If `edge_index_cache` is set, the indices generated are written to
+    // sidecar files in that directory, shared by all ranks, and read from there as long as the edge file is unchanged
+    bool generate_edge_indices = false;
+    unsigned index_threads = 0;
+    std::string edge_index_cache;
+
+    // Merge the targets of a cell at the same location with the same description of a linear synapse
+    // into one synapse instance, shared by their connections. Exact for mechanisms whose response is
+    // linear in the events they receive, which the mechanisms of `linear_synapses` must be
+    bool coalesce_synapses = false;
+    std::vector<std::string> linear_synapses = {"expsyn", "exp2syn"};
+
+    // Add the targets of a cell in order of location (section, then position) instead of edge id, so that
+    // the synapses of a section are next to each other in the mechanism state; the sources are always
+    // in order of location
+    bool order_targets = false;
+};
+
+// Precision lost by the compact edge storage, over all ranks; see database_options::compact_edges
+struct edge_precision_report {
+    // True if the source (target) locations are stored compacted
+    bool compact_sources = false;
+    bool compact_targets = false;
+
+    // Largest difference between a position in the edge files and its stored value
+    double max_position_error = 0;
+
+    // Number of sources merged with another source of the same cell by the quantisation
+    unsigned long merged_sources = 0;
+};
+
 struct current_clamp_info {
     csv_file stim_params;
     csv_file stim_loc;
@@ -46,21 +110,112 @@ inline bool operator==(const source_type& lhs, const source_type& rhs) {
     return lhs.segment == rhs.segment && lhs.position == rhs.position;
 }
 
+// Section and position of a source or target in 32 bits, see database_options::compact_edges
+struct compact_location {
+    std::uint16_t segment;
+    std::uint16_t position; // in units of 1/65535 of the section
+
+    compact_location(): segment(0), position(0) {}
+    compact_location(cell_lid_type s, double p):
+        segment(s), position(std::lround(std::min(std::max(p, 0.), 1.)*65535)) {}
+
+    double position_value() const {
+        return position/65535.;
+    }
+};
+
+inline bool operator==(const compact_location& lhs, const compact_location& rhs) {
+    return lhs.segment == rhs.segment && lhs.position == rhs.position;
+}
+
+inline bool operator<(const compact_location& lhs, const compact_location& rhs) {
+    return std::tie(lhs.segment, lhs.position) < std::tie(rhs.segment, rhs.position);
+}
+
 struct target_type {
     cell_lid_type segment;
+    unsigned synapse; // id in a synapse_table
     double position;
-    arb::mechanism_desc synapse;
 
-    target_type(cell_lid_type s, double p, arb::mechanism_desc m) : segment(s), position(p), synapse(m) {}
+    target_type(cell_lid_type s, double p, unsigned m) : segment(s), synapse(m), position(p) {}
 };
 
 inline bool operator==(const target_type& lhs, const target_type& rhs) {
     return lhs.position == rhs.position &&
            lhs.segment == rhs.segment &&
-           lhs.synapse.name() == rhs.synapse.name() &&
-           lhs.synapse.values() == rhs.synapse.values();
+           lhs.synapse == rhs.synapse;
 }
 
+/// Table of interned point mechanism descriptions
+/// Every distinct (mechanism, parameter set) is stored once and referred to by a small integer id
+/// Descriptions are found by a hash of their name and parameters, so interning builds no key
+class synapse_table {
+public:
+    // Returns the id of `desc`, adding it to the table if it is not there yet
+    unsigned intern(const arb::mechanism_desc& desc) {
+        auto h = hash_of(desc);
+
+        auto it = ids_.find(h);
+        if (it != ids_.end()) {
+            for (auto id = it->second; id != no_id; id = next_[id]) {
+                if (equal(descs_[id], desc)) {
+                    return id;
+                }
+            }
+        }
+
+        unsigned id = descs_.size();
+        descs_.push_back(desc);
+        if (it != ids_.end()) {
+            next_.push_back(it->second);
+            it->second = id;
+        }
+        else {
+            next_.push_back(no_id);
+            ids_.insert({h, id});
+        }
+        return id;
+    }
+
+    const arb::mechanism_desc& operator[](unsigned id) const {
+        return descs_[id];
+    }
+
+    unsigned size() const {
+        return descs_.size();
+    }
+
+private:
+    enum: unsigned { no_id = ~0u };
+
+    // Hash of the name and parameters; parameters are combined independently of their order
+    static std::uint64_t hash_of(const arb::mechanism_desc& desc) {
+        std::uint64_t params = 0;
+        for (auto& v: desc.values()) {
+            params += hash_combine(std::hash<std::string>{}(v.first), std::hash<double>{}(v.second));
+        }
+        return hash_combine(std::hash<std::string>{}(desc.name()), params);
+    }
+
+    static bool equal(const arb::mechanism_desc& a, const arb::mechanism_desc& b) {
+        if (a.name() != b.name() || a.values().size() != b.values().size()) {
+            return false;
+        }
+        for (auto& v: a.values()) {
+            auto it = b.values().find(v.first);
+            if (it == b.values().end() || it->second != v.second) {
+                return false;
+            }
+        }
+        return true;
+    }
+
+    // First id of every hash; next_[id] is the next id with the same hash as `id`, or no_id
+    flat_hash_map<std::uint64_t, unsigned> ids_;
+    std::vector<unsigned> next_;
+    std::vector<arb::mechanism_desc> descs_;
+};
+
 struct trace_info {
     bool is_voltage;
     cell_lid_type seg_id;
@@ -75,9 +230,7 @@ namespace std {
     {
         std::size_t operator()(const source_type& s) const noexcept
         {
-            std::size_t const h1(std::hash<unsigned>{}(s.segment));
-            std::size_t const h2(std::hash<double>{}(s.position));
-            return h1 ^ (h2 << 1);
+            return hash_combine(mix_hash(s.segment), std::hash<double>{}(s.position));
         }
     };
 }
@@ -3,10 +3,16 @@
 #include <arbor/common_types.hpp>
 #include <arbor/swcio.hpp>
 
+#include <cstddef>
+#include <cstdint>
+#include <memory>
 #include <string>
 #include <fstream>
+#include <vector>
 
 #include "density_mech_helper.hpp"
+#include "flat_hash_map.hpp"
+#include "population_names.hpp"
 
 arb::mechanism_desc read_dynamics_params_point(std::string fname);
 std::unordered_map<std::string, mech_groups> read_dynamics_params_density_base(std::string fname);
@@ -14,13 +20,23 @@ std::unordered_map<std::string, variable_map> read_dynamics_params_density_overr
 
 struct type_pop_id {
     unsigned type_tag;
-    std::string pop_name;
+    unsigned pop_id; // id of the population name in population_names
 
-    type_pop_id(unsigned tag, std::string name) : type_tag(tag), pop_name(name){}
+    type_pop_id(unsigned tag, unsigned pop) : type_tag(tag), pop_id(pop) {}
+    type_pop_id(unsigned tag, const std::string& name) : type_tag(tag), pop_id(population_names::intern(name)) {}
+
+    const std::string& pop_name() const {
+        return population_names::name(pop_id);
+    }
+
+    // Type tag and population packed in a single integer
+    std::uint64_t key() const {
+        return (std::uint64_t(pop_id) << 32) | type_tag;
+    }
 };
 
 inline bool operator==(const type_pop_id& lhs, const type_pop_id& rhs) {
-    return lhs.type_tag == rhs.type_tag && lhs.pop_name == rhs.pop_name;
+    return lhs.key() == rhs.key();
 }
 
 namespace std {
@@ -28,38 +44,157 @@ namespace std {
     {
         std::size_t operator()(const type_pop_id& t) const noexcept
         {
-            std::size_t const h1(std::hash<unsigned>{}(t.type_tag));
-            std::size_t const h2(std::hash<std::string>{}(t.pop_name));
-            return h1 ^ (h2 << 1);
+            return t.key();
         }
     };
 }
 
+/// Field of a csv_view: characters of the table, not null terminated
+struct csv_field {
+    const char* data = nullptr;
+    std::size_t size = 0;
+
+    std::string str() const {
+        return std::string(data, size);
+    }
+
+    bool operator==(const std::string& s) const {
+        return s.size() == size && s.compare(0, size, data, size) == 0;
+    }
+
+    // Numeric value of the field, surrounding blanks ignored; throws sonata_exception if the field is not a number
+    long long as_int() const;
+    double as_double() const;
+};
+
+// Numeric value of `f`, surrounding blanks ignored; returns false if `f` is not a number
+// Decimal numbers of at most 15 significant digits and powers of ten up to 22 are parsed exactly without strtod
+bool parse_int(const csv_field& f, long long& value);
+bool parse_double(const csv_field& f, double& value);
+
+/// Table of a csv file, mapped in memory and split into fields without copying them
+/// Fields are separated by the delimiter: a comma, or runs of spaces for space delimited files.
+/// Blank lines are skipped; fields are not unquoted
+class csv_view {
+public:
+    // Row `i` of the table: fields first to last
+    struct row {
+        const csv_field* first;
+        const csv_field* last;
+
+        const csv_field* begin() const { return first; }
+        const csv_field* end() const { return last; }
+        std::size_t size() const { return last - first; }
+        const csv_field& operator[](std::size_t i) const { return first[i]; }
+    };
+
+    // Maps the file at `path`; the delimiter is detected from the first line if `delimiter` is 0
+    // Throws sonata_exception if the file can not be read
+    explicit csv_view(const std::string& path, char delimiter = 0);
+
+    // Table held in memory: `rows` are the lines of the file, split at the delimiter
+    explicit csv_view(const std::vector<std::vector<std::string>>& rows);
+
+    // The fields point into text_, which a copy or a move would leave behind; views are shared instead
+    csv_view(const csv_view&) = delete;
+    csv_view(csv_view&&) = delete;
+    csv_view& operator=(const csv_view&) = delete;
+    csv_view& operator=(csv_view&&) = delete;
+
+    std::size_t num_rows() const {
+        return divs_.size() - 1;
+    }
+
+    row operator[](std::size_t i) const {
+        return {fields_.data() + divs_[i], fields_.data() + divs_[i + 1]};
+    }
+
+    // Index of column `name` in the first row; -1 if there is no such column
+    int column(const std::string& name) const;
+
+private:
+    void split(const char* first, const char* last, char delimiter);
+
+    // Mapping of the file, or text of a table held in memory
+    std::shared_ptr<void> mapping_;
+    std::string text_;
+
+    // Fields of row i are fields_[divs_[i]] to fields_[divs_[i+1]]
+    std::vector<csv_field> fields_;
+    std::vector<std::size_t> divs_;
+};
+
 class csv_file {
     std::string filename;
-    char delimeter;
-    std::vector<std::vector<std::string>> data;
+    std::shared_ptr<const csv_view> view_;
 
 public:
-    csv_file(std::string name, char delm = ',');
+    // The delimiter is detected from the first line of the file if `delm` is 0, see csv_view
+    csv_file(std::string name, char delm = 0);
+
+    // File held in memory: `rows` are the lines of the file, split at the delimiter
+    csv_file(std::string name, std::vector<std::vector<std::string>> rows);
+
+    // Returns the table, shared by the copies of the file
+    const csv_view& view() const;
+
+    // Returns a copy of the table as strings
     std::vector<std::vector<std::string>> get_data();
     std::string name();
 };
 
 ////////////////////////////////////////////////////////
 
+// Map from field names to values of one type_pop_id
+using field_map = flat_hash_map<std::string, std::string>;
+
+/// Type tables, stored column-wise: one row per type_pop_id, one column per field name of any of the files
+/// Fields are parsed as numbers once, so that reading a numeric field costs two array reads.
+/// Columns are named by their id, see column_id; empty fields and columns missing from a file are not set
 class csv_record {
 public:
     csv_record(std::vector<csv_file> files);
 
-    std::vector<type_pop_id> unique_ids();
-    std::unordered_map<std::string, std::string> fields(type_pop_id id);
+    std::vector<type_pop_id> unique_ids() const;
+
+    // Returns the fields of type `id`; throws exception if the type is not found
+    field_map fields(type_pop_id id) const;
+
+    // Id of column `name`, or -1 if no file has such a column
+    int column_id(const std::string& name) const;
+
+    // Whether field `col` of type `id` is set; false if `col` is -1
+    // Throws exception if the type is not found
+    bool has_field(type_pop_id id, int col) const;
+
+    // Field `col` of type `id`; throws exception if the type is not found or the field is not set,
+    // and for double_field if the field is not a number
+    const std::string& string_field(type_pop_id id, int col) const;
+    double double_field(type_pop_id id, int col) const;
 
 protected:
+    // Row of type `id`; throws exception if the type is not found
+    unsigned row(type_pop_id id) const;
+
+    // Row of type `id`; throws exception if the type is not found or field `col` is not set
+    unsigned field_row(type_pop_id id, int col) const;
+
     std::vector<type_pop_id> ids_;
 
-    // Map from type_pop_id to map of fields and values
-    std::unordered_map<type_pop_id, std::unordered_map<std::string, std::string>> fields_;
+    struct column {
+        std::string name;
+        std::vector<std::string> strings;
+        std::vector<double> numbers;
+
+        // Per row: whether the field is set, and whether it is a number
+        std::vector<char> set;
+        std::vector<char> numeric;
+    };
+
+    // Row of every type, and id of every column
+    flat_hash_map<type_pop_id, unsigned> rows_;
+    flat_hash_map<std::string, unsigned> column_ids_;
+    std::vector<column> columns_;
 };
 
 ///////////////////////////////////////////////////////
@@ -79,14 +214,19 @@ public:
     // parameter overrides applied
     std::unordered_map<std::string, std::vector<arb::mechanism_desc>> density_mech_desc(type_pop_id id);
 
+    // Same as above, with the variable overrides in `override` applied on top of the node type's
+    // The record itself is not modified
+    std::unordered_map<std::string, std::vector<arb::mechanism_desc>> density_mech_desc(
+            type_pop_id id, const std::unordered_map<std::string, variable_map>& override);
+
     void override_density_params(type_pop_id id, std::unordered_map<std::string, variable_map> override);
 
 private:
     // Map from type_pop_id to mechanism descriptions
-    std::unordered_map<type_pop_id, std::unordered_map<std::string, mech_groups>> density_params_;
+    flat_hash_map<type_pop_id, std::unordered_map<std::string, mech_groups>> density_params_;
 
     // Map from type_pop_id to map of fields and values
-    std::unordered_map<type_pop_id, arb::morphology> morphologies_;
+    flat_hash_map<type_pop_id, arb::morphology> morphologies_;
 };
 
 class csv_edge_record : public csv_record {
@@ -98,5 +238,5 @@ public:
 private:
 
     // Map from type_pop_id to point_mechanisms_desc
-    std::unordered_map<type_pop_id, arb::mechanism_desc> point_params_;
+    flat_hash_map<type_pop_id, arb::mechanism_desc> point_params_;
 };
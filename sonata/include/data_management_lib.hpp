@@ -5,13 +5,19 @@
 #include <arbor/domain_decomposition.hpp>
 #include <arbor/recipe.hpp>
 
+#include <algorithm>
+#include <cstdint>
 #include <string>
 #include <unordered_set>
 
+#include "arena.hpp"
+#include "circuit_image.hpp"
+#include "circuit_source.hpp"
 #include "hdf5_lib.hpp"
 #include "csv_lib.hpp"
 #include "sonata_exceptions.hpp"
 #include "common_structs.hpp"
+#include "shared_table.hpp"
 
 using arb::cell_gid_type;
 using arb::cell_lid_type;
@@ -26,43 +32,72 @@ public:
              csv_node_record node_types,
              csv_edge_record edge_types,
              std::vector<spike_info> spikes,
-             std::vector<current_clamp_info> current_clamp):
-    nodes_(nodes), edges_(edges), node_types_(node_types), edge_types_(edge_types), spikes_(spikes) {
-        build_current_clamp_map(current_clamp);
-    }
+             std::vector<current_clamp_info> current_clamp,
+             database_options opts = {}):
+    database(nodes, edges, node_types, edge_types, spikes, current_clamp, opts, 0) {}
+
+    // The circuit can be compiled to an image, see database_options::circuit_cache
+    // Its content hash, which can read every component file, is only computed if the cache is enabled
+    database(const circuit_source& circuit, database_options opts = {}):
+    database(circuit.nodes(), circuit.edges(), circuit.node_types(), circuit.edge_types(),
+             circuit.spikes(), circuit.current_clamps(), opts,
+             opts.circuit_cache.empty() ? 0 : circuit.content_hash()) {}
+
+    /* Run phase: available for the whole lifetime of the database */
 
     std::vector<unsigned> pop_partitions() const {
-        return nodes_.partitions();
+        return pop_partitions_;
     }
 
     std::vector<std::string> pop_names() const {
-        return nodes_.pop_names();
+        return pop_names_;
     }
 
-    std::string population_of(cell_gid_type gid) {
-        for (unsigned i = 0; i < nodes_.partitions().size(); i++) {
-            if (gid < nodes_.partitions()[i]) {
-                return nodes_.populations()[i-1].name();
+    std::string population_of(cell_gid_type gid) const {
+        for (unsigned i = 0; i < pop_partitions_.size(); i++) {
+            if (gid < pop_partitions_[i]) {
+                return pop_names_[i-1];
             }
         }
+        throw sonata_exception(pprintf("cell {} is not in any population", gid));
     }
 
-    unsigned population_id_of(cell_gid_type gid) {
-        for (unsigned i = 0; i < nodes_.partitions().size(); i++) {
-            if (gid < nodes_.partitions()[i]) {
-                return gid - nodes_.partitions()[i-1];
+    unsigned population_id_of(cell_gid_type gid) const {
+        for (unsigned i = 0; i < pop_partitions_.size(); i++) {
+            if (gid < pop_partitions_[i]) {
+                return gid - pop_partitions_[i-1];
             }
         }
+        throw sonata_exception(pprintf("cell {} is not in any population", gid));
     }
 
-    cell_size_type num_cells() {
-        return nodes_.num_elements();
+    cell_size_type num_cells() const {
+        return num_cells_;
     }
-    cell_size_type num_edges() {
-        return edges_.num_elements();
+    cell_size_type num_edges() const {
+        return num_edges_;
     }
-    void build_source_and_target_maps(const std::vector<arb::group_description>&);
 
+    // Precision lost by the compact edge storage; set by build_local_maps
+    edge_precision_report edge_precision() const {
+        return precision_;
+    }
+
+    // Lock-free, from the table built in the constructor; also available once the build state is released
+    arb::cell_kind get_cell_kind(cell_gid_type gid) const;
+
+    // Frees everything that is only needed to build the simulation: the HDF5 and CSV records,
+    // the connectivity, cell description and input tables.
+    // Only the population layout used by probes and outputs, and the cell kinds, stay resident; the build
+    // phase functions below throw once it is called. Collective if the tables are shared.
+    void release_build_state();
+
+    /* Build phase: until release_build_state() */
+
+    // Builds all the rank-local tables, once the domain decomposition is known
+    void build_local_maps(const std::vector<arb::group_description>&);
+
+    // Parses the electrodes of `current` that are placed on local cells into current_clamps_
     void build_current_clamp_map(std::vector<current_clamp_info> current);
 
     void get_connections(cell_gid_type gid, std::vector<arb::cell_connection>& conns);
@@ -72,8 +107,10 @@ public:
                                  std::vector<std::pair<segment_location, arb::mechanism_desc>>& tgt);
 
     std::vector<current_clamp> get_current_clamps(cell_gid_type gid) {
-        if (current_clamps_.find(gid) != current_clamps_.end()) {
-            return current_clamps_.at(gid);
+        require_build_state();
+        auto it = current_clamps_.find(gid);
+        if (it != current_clamps_.end()) {
+            return it->second;
         }
         return {};
     };
@@ -82,8 +119,6 @@ public:
 
     arb::morphology get_cell_morphology(cell_gid_type gid);
 
-    arb::cell_kind get_cell_kind(cell_gid_type gid);
-
     // Returns section -> mechanisms
     std::unordered_map<std::string, std::vector<arb::mechanism_desc>> get_density_mechs(cell_gid_type);
 
@@ -91,12 +126,122 @@ public:
     unsigned num_targets(cell_gid_type gid);
 
 private:
+    // `circuit_key` is the content hash of the circuit, 0 if it is unknown and the circuit can not be cached
+    database(h5_record nodes,
+             h5_record edges,
+             csv_node_record node_types,
+             csv_edge_record edge_types,
+             std::vector<spike_info> spikes,
+             std::vector<current_clamp_info> current_clamp,
+             database_options opts,
+             std::uint64_t circuit_key):
+    nodes_(nodes), edges_(edges), node_types_(node_types), edge_types_(edge_types), clamp_inputs_(current_clamp), spikes_(spikes), opts_(opts),
+    circuit_key_(circuit_key),
+    pop_partitions_(nodes_.partitions()), pop_names_(nodes_.pop_names()),
+    num_cells_(nodes_.num_elements()), num_edges_(edges_.num_elements()) {
+        open_circuit_image();
+        if (!image_) {
+            build_edge_indices();
+            build_uniform_nodes();
+        }
+        build_cell_kinds();
+    }
+
+    /* Compiled circuit image */
+
+    // Path of the image of the circuit in opts_.circuit_cache
+    std::string circuit_image_path() const;
+
+    // Maps the image of the circuit, if caching is enabled and the image exists; collective
+    void open_circuit_image();
+
+    // Writes the image of the circuit, once the local maps are built; collective
+    void write_circuit_image();
 
     /* Read relevant information from HDF5 or CSV */
-    std::vector<source_type> source_range(unsigned edge_pop_id, std::pair<unsigned, unsigned> edge_range);
-    std::vector<target_type> target_range(unsigned edge_pop_id, std::pair<unsigned, unsigned> edge_range);
-    std::vector<double> weight_range(unsigned edge_pop_id, std::pair<unsigned, unsigned> edge_range);
-    std::vector<double> delay_range(unsigned edge_pop_id, std::pair<unsigned, unsigned> edge_range);
+    arena_vector<source_type> source_range(unsigned edge_pop_id, std::pair<unsigned, unsigned> edge_range);
+    arena_vector<target_type> target_range(unsigned edge_pop_id, std::pair<unsigned, unsigned> edge_range);
+    arena_vector<double> weight_range(unsigned edge_pop_id, std::pair<unsigned, unsigned> edge_range);
+    arena_vector<double> delay_range(unsigned edge_pop_id, std::pair<unsigned, unsigned> edge_range);
+
+    // Number of synapses of every edge: the "nsyns" attribute, 1 if the edge has none
+    // An edge with nsyns synapses has nsyns targets at its afferent location and nsyns connections
+    arena_vector<unsigned> nsyns_range(unsigned edge_pop_id, std::pair<unsigned, unsigned> edge_range);
+
+    /* Columns and attributes that are the same for a whole population */
+    struct uniform_column {
+        bool uniform;
+        int value;
+    };
+
+    struct uniform_node_attributes {
+        uniform_column group_id = {false, 0};
+        uniform_column type_id = {false, 0};
+    };
+
+    struct uniform_edge_attributes {
+        uniform_column group_id = {false, 0};
+        uniform_column type_id = {false, 0};
+
+        // Constant attributes, when every edge has the same group and type
+        // and the attribute is not stored in the group
+        bool const_source = false;
+        bool const_target = false;
+        bool const_weight = false;
+        bool const_delay = false;
+        bool const_nsyns = false;
+
+        source_type source;
+        target_type target = target_type(0, 0, 0);
+        double weight = 0;
+        double delay = 0;
+        unsigned nsyns = 1;
+    };
+
+    // Generates the indicies group of the edge populations that lack it, if opts_.generate_edge_indices is set;
+    // throws otherwise. In the constructor, collective
+    void build_edge_indices();
+
+    // Detects the uniform group id columns of node populations, in the constructor; collective
+    void build_uniform_nodes();
+
+    // Builds cell_kinds_, and detects the uniform type id columns of node populations from the same pass
+    // over the types; collective if the tables are shared
+    void build_cell_kinds();
+
+    // Fills the kinds of all the cells, and returns the smallest and largest type id of every population
+    std::vector<std::pair<int, int>> fill_cell_kinds(std::uint8_t* kinds);
+
+    // Detects the uniform columns and constant attributes of edge populations; collective
+    void build_uniform_edges();
+
+    // Reads integer dataset `name` of `pop` over `range`; a uniform column is not read
+    std::vector<int> column_range(const h5_wrapper& pop, const std::string& name,
+                                  uniform_column col, std::pair<unsigned, unsigned> range) const {
+        if (col.uniform) {
+            return std::vector<int>(range.second - range.first, col.value);
+        }
+        return pop.int_range(name, range.first, range.second);
+    }
+
+    // Group with id `group_id` of edge population `edge_pop_id`, null if there is none; cached in edge_groups_
+    const h5_wrapper* edge_group(unsigned edge_pop_id, int group_id);
+
+    // Key of an edge group and an edge type of the same population in edge_group_cache::synapses
+    static std::uint64_t edge_group_key(int group_id, int type_id) {
+        return (std::uint64_t)(std::uint32_t)group_id << 32 | (std::uint32_t)type_id;
+    }
+
+    // Reads integer dataset `name` of `pop` at index `i`; a uniform column is not read
+    int column_at(const h5_wrapper& pop, const std::string& name, uniform_column col, unsigned i) const {
+        return col.uniform ? col.value : pop.int_at(name, i);
+    }
+
+    /* Rank-local tables, built in build_local_maps */
+    void build_node_columns();
+    void build_density_overrides();
+    void build_source_and_target_maps();
+    void build_spike_map();
 
     /* Helper functions */
     struct local_element{
@@ -114,6 +259,24 @@ private:
         return local_element();
     }
 
+    // Index of `gid` among the cells of this rank; -1 if the cell is not local
+    int find_local(cell_gid_type gid) const {
+        auto it = std::lower_bound(local_gids_.begin(), local_gids_.end(), gid);
+        if (it == local_gids_.end() || *it != gid) {
+            return -1;
+        }
+        return it - local_gids_.begin();
+    }
+
+    // Index of `gid` among the cells of this rank; throws if the cell is not local
+    unsigned local_index(cell_gid_type gid) const {
+        auto lid = find_local(gid);
+        if (lid == -1) {
+            throw sonata_exception(pprintf("cell {} is not local to this rank", gid));
+        }
+        return lid;
+    }
+
     cell_gid_type globalize_cell(local_element n) {
         return n.el_id + nodes_.partitions()[n.pop_id];
     }
@@ -122,13 +285,16 @@ private:
         return e.el_id + edges_.partitions()[e.pop_id];
     }
 
+    // The edge types are read column-wise: fields() would build a map of every field of every type
     std::unordered_map<unsigned, unsigned> edge_to_source_of_target(unsigned target_pop) {
         std::unordered_map <unsigned, unsigned> edge_to_source;
 
+        auto target_col = edge_types_.column_id("target_pop_name");
+        auto source_col = edge_types_.column_id("source_pop_name");
+        auto target_name = nodes_[target_pop].name();
         for (auto id: edge_types_.unique_ids()) {
-            auto type = edge_types_.fields(id);
-            if (type["target_pop_name"] == nodes_[target_pop].name()) {
-                edge_to_source[edges_.map()[type["pop_name"]]] = nodes_.map()[type["source_pop_name"]];
+            if (edge_types_.has_field(id, target_col) && edge_types_.string_field(id, target_col) == target_name) {
+                edge_to_source[edges_.map()[id.pop_name()]] = nodes_.map()[edge_types_.string_field(id, source_col)];
             }
         }
         return edge_to_source;
@@ -137,10 +303,11 @@ private:
     std::unordered_set<unsigned> edges_of_target(unsigned target_pop) {
         std::unordered_set<unsigned> target_edge_pops;
 
+        auto target_col = edge_types_.column_id("target_pop_name");
+        auto target_name = nodes_[target_pop].name();
         for (auto id: edge_types_.unique_ids()) {
-            auto type = edge_types_.fields(id);
-            if (type["target_pop_name"] == nodes_[target_pop].name()) {
-                target_edge_pops.insert(edges_.map()[type["pop_name"]]);
+            if (edge_types_.has_field(id, target_col) && edge_types_.string_field(id, target_col) == target_name) {
+                target_edge_pops.insert(edges_.map()[id.pop_name()]);
             }
         }
         return target_edge_pops;
@@ -149,24 +316,167 @@ private:
     std::unordered_set<unsigned> edges_of_source(unsigned source_pop) {
         std::unordered_set<unsigned> source_edge_pops;
 
+        auto source_col = edge_types_.column_id("source_pop_name");
+        auto source_name = nodes_[source_pop].name();
         for (auto id: edge_types_.unique_ids()) {
-            auto type = edge_types_.fields(id);
-            if (type["source_pop_name"] == nodes_[source_pop].name()) {
-                source_edge_pops.insert(edges_.map()[type["pop_name"]]);
+            if (edge_types_.has_field(id, source_col) && edge_types_.string_field(id, source_col) == source_name) {
+                source_edge_pops.insert(edges_.map()[id.pop_name()]);
             }
         }
         return source_edge_pops;
     }
 
+    // Build phase state: the records the network is read from
     h5_record nodes_;
     h5_record edges_;
     csv_node_record node_types_;
     csv_edge_record edge_types_;
 
-    std::unordered_map<cell_gid_type, std::vector<current_clamp>> current_clamps_;
+    // Current clamp inputs, parsed for the local cells only in build_local_maps
+    std::vector<current_clamp_info> clamp_inputs_;
+    flat_hash_map<cell_gid_type, std::vector<current_clamp>> current_clamps_;
+
+    // Spike inputs, loaded for the local cells only in build_local_maps
     std::vector<spike_info> spikes_;
 
-    std::unordered_map<cell_gid_type, std::vector<source_type>> source_maps_;
-    std::unordered_map<cell_gid_type, std::vector<std::pair<target_type, unsigned>>> target_maps_;
+    database_options opts_;
+
+    // Content hash of the circuit, 0 if unknown
+    std::uint64_t circuit_key_;
+
+    // Image the network is read from, null if the network is read from the records
+    // The tables below map the image; image_synapses_ holds the id in synapses_ of every synapse of the image
+    std::shared_ptr<circuit_image> image_;
+    shared_table<image_cell> image_cells_;
+    shared_table<target_type> image_targets_;
+    shared_table<unsigned> image_target_edges_;
+    shared_table<image_connection> image_connections_;
+    std::vector<unsigned> image_synapses_;
+
+    // Run phase state
+    std::vector<unsigned> pop_partitions_;
+    std::vector<std::string> pop_names_;
+    cell_size_type num_cells_;
+    cell_size_type num_edges_;
+    edge_precision_report precision_;
+
+    // arb::cell_kind of every cell in the network, one byte per cell
+    shared_table<std::uint8_t> cell_kinds_;
+
+    bool released_ = false;
+
+    // Throws if release_build_state() has been called
+    void require_build_state() const {
+        if (released_) {
+            throw sonata_exception("database build state accessed after release_build_state()");
+        }
+    }
+
+    // Build phase state: tables built from the records
+
+    // Temporaries of the per-cell and per-range loops, rewound with an arena_scope at the end of every iteration
+    monotonic_arena arena_;
+
+    std::vector<uniform_node_attributes> uniform_nodes_;
+    std::vector<uniform_edge_attributes> uniform_edges_;
+
+    // Edge groups resolved by the range functions, per edge population: `groups` maps a group id to the
+    // index of the group in the population, -1 if there is none; `synapses` maps the edge_group_key of a group
+    // and a type to the synapse id of their edges, if the group holds no synapse attribute
+    struct edge_group_cache {
+        flat_hash_map<int, int> groups;
+        flat_hash_map<std::uint64_t, unsigned> synapses;
+    };
+    std::vector<edge_group_cache> edge_groups_;
+
+    // Sorted gids of the cells on this rank
+    std::vector<cell_gid_type> local_gids_;
+
+    // Node attributes of the local cells, indexed by local index
+    struct node_columns {
+        std::vector<unsigned> pop_id;
+        std::vector<int> type_id;
+        std::vector<int> group_id;
+        std::vector<int> group_index;
+    };
+    node_columns local_nodes_;
+
+    // Overrides of density mechanism variables for the local cells, from the dynamics_params of node groups
+    // Column `c` overrides variable vars[c].second of mechanism group vars[c].first;
+    // values[c] is indexed by local index, NaN where the cell doesn't override the variable
+    struct density_override_table {
+        std::vector<std::pair<std::string, std::string>> vars;
+        std::vector<std::vector<double>> values;
+    };
+    density_override_table density_overrides_;
+
+    // Input spike times of the local cells, sorted
+    // Spikes of local cell `i` are spike_times_[spike_divs_[i]] to spike_times_[spike_divs_[i+1]]
+    std::vector<unsigned> spike_divs_;
+    std::vector<double> spike_times_;
+
+    // Sources of every cell in the network, sorted by (segment, position)
+    // Sources of `gid` are source_maps_[source_divs_[gid]] to source_maps_[source_divs_[gid+1]]
+    // If precision_.compact_sources is set, compact_source_maps_ is used instead of source_maps_
+    shared_table<unsigned> source_divs_;
+    shared_table<source_type> source_maps_;
+    shared_table<compact_location> compact_source_maps_;
+
+    // Targets of a set of local cells, sorted by global edge id
+    // Targets of the cell at row `i` are maps[divs[i]] to maps[divs[i+1]], edges holds the global edge
+    // id of every target: an edge with nsyns synapses has nsyns consecutive targets.
+    // If `compact` is set, compact_maps is used instead of maps
+    // If has_instances(), the targets are presented to arbor as synapse instances: instances holds the
+    // instance (arbor target index) of every target, numbered per row in order of first use, or by location
+    // if opts_.order_targets is set; the row has instance_divs[i+1] - instance_divs[i] instances, and the
+    // first target of every instance describes it. Targets only share an instance if opts_.coalesce_synapses is set
+    struct compact_target {
+        compact_location location;
+        unsigned synapse;
+    };
+    struct target_table {
+        std::vector<unsigned> divs;
+        std::vector<target_type> maps;
+        std::vector<compact_target> compact_maps;
+        std::vector<unsigned> edges;
+        std::vector<unsigned> instances;
+        std::vector<unsigned> instance_divs;
+        bool compact = false;
+    };
+
+    // Targets of all the local cells, the row of a cell is its local index; empty in streaming mode
+    target_table targets_;
+
+    // Streaming mode (opts_.resident_groups > 0): the targets are loaded per cell group on demand,
+    // and at most opts_.resident_groups tables are kept
+    // Local cell `i` is at row local_rows_[i] of the table of group local_groups_[i];
+    // resident_groups_ lists the loaded groups, the most recently used last
+    std::vector<std::vector<cell_gid_type>> group_gids_;
+    std::vector<unsigned> local_groups_;
+    std::vector<unsigned> local_rows_;
+    std::vector<target_table> group_targets_;
+    std::vector<unsigned> resident_groups_;
+
+    // Appends the targets of local cell `gid` as the next row of `table`
+    void append_targets(cell_gid_type gid, target_table& table);
+
+    // True if targets are numbered by instances, see target_table
+    bool has_instances() const {
+        return opts_.coalesce_synapses || opts_.order_targets;
+    }
+
+    // Assigns the instances of the last row of `table`: targets at the same location with the same
+    // description of a linear synapse (opts_.linear_synapses) share one instance if opts_.coalesce_synapses is set
+    void assign_instances(target_table& table);
+
+    // Table holding the targets of local cell `lid`, and the row of the cell in it
+    // In streaming mode the targets of the cell group are loaded if needed
+    std::pair<const target_table*, unsigned> targets_of(unsigned lid);
+
+    // Loads the targets of cell group `g`, evicting the least recently used group if the limit is reached
+    void load_group_targets(unsigned g);
+
+    // Distinct synapse descriptions referred to by the target tables
+    synapse_table synapses_;
 };
 
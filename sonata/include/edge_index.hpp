@@ -0,0 +1,45 @@
+#pragma once
+
+#include <memory>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "hdf5_lib.hpp"
+
+/// Index of the edges of a population by node, laid out as the source_to_target and target_to_source
+/// groups of the SONATA "indicies" group: the edges of node n are the edge ranges
+/// range_to_edge_id[node_id_to_ranges[n].first .. node_id_to_ranges[n].second)
+/// Used to load edge files written without indices, see database_options::generate_edge_indices
+struct edge_index {
+    std::vector<std::pair<int, int>> node_id_to_ranges;
+    std::vector<std::pair<int, int>> range_to_edge_id;
+};
+
+// Edges [first, last) all have the node `node`
+struct edge_run {
+    int node;
+    int first;
+    int last;
+};
+
+// Runs of equal ids in `ids`, the node ids of edges `first` to `first + ids.size()`
+// The ids are split over `num_threads` threads; runs are in edge order
+std::vector<edge_run> find_edge_runs(const std::vector<int>& ids, int first, unsigned num_threads);
+
+// Index of `num_nodes` nodes from the runs of every edge of a population, in edge order
+// The runs are radix sorted by node id on `num_threads` threads, and runs that continue each other are merged
+// Throws sonata_exception if a node id is not in [0, num_nodes)
+edge_index index_edge_runs(std::vector<edge_run> runs, unsigned num_nodes, unsigned num_threads);
+
+// "indicies" group held in memory
+std::shared_ptr<h5_group> make_index_group(edge_index source_to_target, edge_index target_to_source);
+
+// Sidecar file of the indices of population `population`: an HDF5 file with the group
+// /<population>/indicies laid out as in a SONATA edge file
+void write_index_file(const std::string& path, const std::string& population,
+                      const edge_index& source_to_target, const edge_index& target_to_source);
+
+// Group "indicies" of population `population` of the sidecar file at `path`, read into memory;
+// null if there is no such file
+std::shared_ptr<h5_group> read_index_file(const std::string& path, const std::string& population);
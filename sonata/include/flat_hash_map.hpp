@@ -0,0 +1,322 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <initializer_list>
+#include <iterator>
+#include <new>
+#include <stdexcept>
+#include <tuple>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+// Finalizer of splitmix64: spreads every input bit over the whole hash
+// std::hash of integers is the identity in most standard libraries, which clusters in a power of two table
+inline std::size_t mix_hash(std::size_t h) {
+    std::uint64_t x = h;
+    x ^= x >> 30;
+    x *= 0xbf58476d1ce4e5b9ull;
+    x ^= x >> 27;
+    x *= 0x94d049bb133111ebull;
+    x ^= x >> 31;
+    return x;
+}
+
+// Combines the hash `h` of a member into the hash `seed` of the whole object
+inline std::size_t hash_combine(std::size_t seed, std::size_t h) {
+    return seed ^ (mix_hash(h) + 0x9e3779b97f4a7c15ull + (seed << 6) + (seed >> 2));
+}
+
+// FNV-1a hash of `n` bytes; unlike std::hash the value is the same in every run, so it can be stored
+inline std::uint64_t hash_bytes(const void* data, std::size_t n, std::uint64_t h = 0xcbf29ce484222325ull) {
+    auto p = static_cast<const unsigned char*>(data);
+    for (std::size_t i = 0; i < n; i++) {
+        h = (h ^ p[i])*0x100000001b3ull;
+    }
+    return h;
+}
+
+/// Hash map with open addressing and Robin Hood probing
+/// Elements are stored inline in a single power of two table, and probe sequences are kept short
+/// by displacing elements closer to their home bucket than the one being inserted
+/// Covers the part of the std::unordered_map interface used in this library; unlike std::unordered_map,
+/// insertions and erasures invalidate all iterators and references
+template <typename K, typename V, typename Hash = std::hash<K>, typename Eq = std::equal_to<K>>
+class flat_hash_map {
+public:
+    using key_type = K;
+    using mapped_type = V;
+    using value_type = std::pair<K, V>;
+    using size_type = std::size_t;
+
+    template <bool Const>
+    class iter {
+        using map_ptr = typename std::conditional<Const, const flat_hash_map*, flat_hash_map*>::type;
+
+    public:
+        using iterator_category = std::forward_iterator_tag;
+        using value_type = flat_hash_map::value_type;
+        using difference_type = std::ptrdiff_t;
+        using reference = typename std::conditional<Const, const value_type&, value_type&>::type;
+        using pointer = typename std::conditional<Const, const value_type*, value_type*>::type;
+
+        iter() {}
+        iter(map_ptr m, size_type i): map_(m), i_(i) { skip_empty(); }
+
+        // Conversion from iterator to const_iterator
+        template <bool C = Const, typename = typename std::enable_if<C>::type>
+        iter(const iter<false>& other): map_(other.map_), i_(other.i_) {}
+
+        reference operator*() const { return map_->slots_[i_]; }
+        pointer operator->() const { return &map_->slots_[i_]; }
+
+        iter& operator++() {
+            ++i_;
+            skip_empty();
+            return *this;
+        }
+        iter operator++(int) {
+            auto tmp = *this;
+            ++*this;
+            return tmp;
+        }
+
+        bool operator==(const iter& other) const { return i_ == other.i_; }
+        bool operator!=(const iter& other) const { return i_ != other.i_; }
+
+    private:
+        friend class flat_hash_map;
+        template <bool> friend class iter;
+
+        void skip_empty() {
+            while (i_ < map_->capacity() && !map_->dist_[i_]) ++i_;
+        }
+
+        map_ptr map_ = nullptr;
+        size_type i_ = 0;
+    };
+
+    using iterator = iter<false>;
+    using const_iterator = iter<true>;
+
+    flat_hash_map() {}
+
+    explicit flat_hash_map(size_type n) {
+        reserve(n);
+    }
+
+    flat_hash_map(std::initializer_list<value_type> values) {
+        reserve(values.size());
+        for (auto& v: values) {
+            insert(v);
+        }
+    }
+
+    flat_hash_map(const flat_hash_map& other) {
+        reserve(other.size_);
+        for (auto& v: other) {
+            insert_new(value_type(v));
+        }
+    }
+
+    flat_hash_map(flat_hash_map&& other) noexcept {
+        swap(other);
+    }
+
+    flat_hash_map& operator=(flat_hash_map other) noexcept {
+        swap(other);
+        return *this;
+    }
+
+    ~flat_hash_map() {
+        destroy();
+    }
+
+    void swap(flat_hash_map& other) noexcept {
+        std::swap(slots_, other.slots_);
+        dist_.swap(other.dist_);
+        std::swap(size_, other.size_);
+        std::swap(hash_, other.hash_);
+        std::swap(eq_, other.eq_);
+    }
+
+    iterator begin() { return iterator(this, 0); }
+    iterator end() { return iterator(this, capacity()); }
+    const_iterator begin() const { return const_iterator(this, 0); }
+    const_iterator end() const { return const_iterator(this, capacity()); }
+
+    size_type size() const { return size_; }
+    bool empty() const { return size_ == 0; }
+    size_type capacity() const { return dist_.size(); }
+
+    void clear() {
+        for (size_type i = 0; i < capacity(); i++) {
+            if (dist_[i]) {
+                slots_[i].~value_type();
+                dist_[i] = 0;
+            }
+        }
+        size_ = 0;
+    }
+
+    // Makes room for `n` elements without rehashing
+    void reserve(size_type n) {
+        size_type cap = 16;
+        while (cap*max_load_num < n*max_load_den) cap *= 2;
+        if (cap > capacity()) {
+            rehash(cap);
+        }
+    }
+
+    iterator find(const K& key) {
+        return iterator(this, find_index(key));
+    }
+    const_iterator find(const K& key) const {
+        return const_iterator(this, find_index(key));
+    }
+
+    size_type count(const K& key) const {
+        return find_index(key) != capacity();
+    }
+
+    V& at(const K& key) {
+        auto i = find_index(key);
+        if (i == capacity()) throw std::out_of_range("flat_hash_map::at");
+        return slots_[i].second;
+    }
+    const V& at(const K& key) const {
+        auto i = find_index(key);
+        if (i == capacity()) throw std::out_of_range("flat_hash_map::at");
+        return slots_[i].second;
+    }
+
+    V& operator[](const K& key) {
+        return try_emplace(key).first->second;
+    }
+
+    std::pair<iterator, bool> insert(value_type v) {
+        auto i = find_index(v.first);
+        if (i != capacity()) {
+            return {iterator(this, i), false};
+        }
+        return {iterator(this, insert_new(std::move(v))), true};
+    }
+
+    template <typename... Args>
+    std::pair<iterator, bool> try_emplace(const K& key, Args&&... args) {
+        auto i = find_index(key);
+        if (i != capacity()) {
+            return {iterator(this, i), false};
+        }
+        return {iterator(this, insert_new(value_type(std::piecewise_construct,
+                                                     std::forward_as_tuple(key),
+                                                     std::forward_as_tuple(std::forward<Args>(args)...)))), true};
+    }
+
+    size_type erase(const K& key) {
+        auto i = find_index(key);
+        if (i == capacity()) {
+            return 0;
+        }
+
+        // Backward shift deletion: move the following elements of the probe sequence one slot back
+        slots_[i].~value_type();
+        auto j = (i + 1) & mask();
+        while (dist_[j] > 1) {
+            new (slots_ + i) value_type(std::move(slots_[j]));
+            slots_[j].~value_type();
+            dist_[i] = dist_[j] - 1;
+            i = j;
+            j = (j + 1) & mask();
+        }
+        dist_[i] = 0;
+        size_--;
+        return 1;
+    }
+
+private:
+    // Rehash when the table is 7/8 full
+    static constexpr size_type max_load_num = 7;
+    static constexpr size_type max_load_den = 8;
+
+    size_type mask() const { return capacity() - 1; }
+
+    size_type home(const K& key) const {
+        return mix_hash(hash_(key)) & mask();
+    }
+
+    // Slot of `key`, or capacity() if not present
+    size_type find_index(const K& key) const {
+        if (!size_) {
+            return capacity();
+        }
+        auto i = home(key);
+        for (std::uint32_t d = 1;; d++, i = (i + 1) & mask()) {
+            if (dist_[i] < d) {
+                return capacity();
+            }
+            if (dist_[i] == d && eq_(slots_[i].first, key)) {
+                return i;
+            }
+        }
+    }
+
+    // Inserts `v`, which is not in the map yet, and returns its slot
+    size_type insert_new(value_type v) {
+        if ((size_ + 1)*max_load_den > capacity()*max_load_num) {
+            rehash(capacity() ? 2*capacity() : 16);
+        }
+
+        auto found = capacity();
+        auto i = home(v.first);
+        for (std::uint32_t d = 1;; d++, i = (i + 1) & mask()) {
+            if (!dist_[i]) {
+                new (slots_ + i) value_type(std::move(v));
+                dist_[i] = d;
+                size_++;
+                return found == capacity() ? i : found;
+            }
+            // Take the slot of an element closer to its home bucket, and carry on inserting that one
+            if (dist_[i] < d) {
+                std::swap(v, slots_[i]);
+                std::swap(d, dist_[i]);
+                if (found == capacity()) {
+                    found = i;
+                }
+            }
+        }
+    }
+
+    void rehash(size_type cap) {
+        flat_hash_map old;
+        swap(old);
+        hash_ = old.hash_;
+        eq_ = old.eq_;
+
+        slots_ = static_cast<value_type*>(::operator new(cap*sizeof(value_type)));
+        dist_.assign(cap, 0);
+        for (size_type i = 0; i < old.capacity(); i++) {
+            if (old.dist_[i]) {
+                insert_new(std::move(old.slots_[i]));
+            }
+        }
+    }
+
+    void destroy() {
+        clear();
+        ::operator delete(slots_);
+        slots_ = nullptr;
+        dist_.clear();
+    }
+
+    value_type* slots_ = nullptr;
+
+    // Distance of every slot from the home bucket of its element, plus one; 0 for empty slots
+    std::vector<std::uint32_t> dist_;
+
+    size_type size_ = 0;
+    Hash hash_;
+    Eq eq_;
+};
@@ -1,47 +1,77 @@
 #pragma once
 
 #include <iostream>
+#include <memory>
 #include <string>
+#include <unordered_map>
+#include <utility>
+#include <vector>
 
 #include <hdf5.h>
 
-/// Class for reading from hdf5 datasets
-/// Datasets are opened and closed every time they are read
-class h5_dataset {
+#include "population_names.hpp"
+
+/// Read access to a dataset of a group: one dimensional, or of dimensions size() x 2 for the pair accessors
+/// Implemented by h5_dataset for datasets in HDF5 files, and by datasets generated in memory,
+/// see procedural_circuit.hpp
+class storage_dataset {
 public:
-    // Constructor from parent (hdf5 group) id and dataset name - finds size of the dataset
-    h5_dataset(hid_t parent, std::string name);
+    virtual ~storage_dataset() {}
 
     // returns name of dataset
-    std::string name();
+    virtual std::string name() = 0;
 
     // returns number of elements in a dataset
-    int size();
+    virtual int size() = 0;
 
     // Read integer at index `i`; throws exception if out of bounds
-    auto int_at(const int i);
+    virtual int int_at(const int i) = 0;
 
     // Read double at index `i`; throws exception if out of bounds
-    auto double_at(const int i);
+    virtual double double_at(const int i) = 0;
 
-    // Read string at index `i`; throws exception if out of bounds
-    auto string_at(const int i);
+    // Read character at index `i`; throws exception if out of bounds
+    virtual int string_at(const int i) = 0;
 
     // Read range of integers between indices `i` and `j`; throws exception if out of bounds
-    auto int_range(const int i, const int j);
+    virtual std::vector<int> int_range(const int i, const int j) = 0;
 
     // Read range of doubles between indices `i` and `j`; throws exception if out of bounds
-    auto double_range(const int i, const int j);
+    virtual std::vector<double> double_range(const int i, const int j) = 0;
 
     // Read integer pair at index `i` (dataset has dimensions size() x 2)
     // Throws exception if out of bounds
-    auto int_pair_at(const int i);
+    virtual std::pair<int, int> int_pair_at(const int i) = 0;
+
+    // Read integer pairs between indices `i` and `j` (dataset has dimensions size() x 2)
+    // Throws exception if out of bounds
+    virtual std::vector<std::pair<int, int>> int_pair_range(const int i, const int j) = 0;
 
     // Read all 1D integer dataset
-    auto int_1d();
+    virtual std::vector<int> int_1d() = 0;
 
     // Read all 2D integer dataset
-    auto int_2d();
+    virtual std::vector<std::pair<int, int>> int_2d() = 0;
+};
+
+/// Class for reading from hdf5 datasets
+/// Datasets are opened and closed every time they are read
+class h5_dataset: public storage_dataset {
+public:
+    // Constructor from parent (hdf5 group) id and dataset name - finds size of the dataset
+    h5_dataset(hid_t parent, std::string name);
+
+    std::string name() override;
+    int size() override;
+    int int_at(const int i) override;
+    double double_at(const int i) override;
+    int string_at(const int i) override;
+    std::vector<int> int_range(const int i, const int j) override;
+    std::vector<double> double_range(const int i, const int j) override;
+    std::pair<int, int> int_pair_at(const int i) override;
+    std::vector<std::pair<int, int>> int_pair_range(const int i, const int j) override;
+    std::vector<int> int_1d() override;
+    std::vector<std::pair<int, int>> int_2d() override;
 
 private:
     // id of parent group
@@ -62,6 +92,11 @@ public:
     // Builds tree of groups, each with it's own sub-groups and datasets
     h5_group(hid_t parent, std::string name);
 
+    // Group held in memory, not backed by an hdf5 file
+    h5_group(std::string name,
+             std::vector<std::shared_ptr<h5_group>> groups,
+             std::vector<std::shared_ptr<storage_dataset>> datasets);
+
     // Returns name of group
     std::string name();
 
@@ -69,7 +104,7 @@ public:
     std::vector<std::shared_ptr<h5_group>> groups_;
 
     // hdf5 datasets belonging to group
-    std::vector<std::shared_ptr<h5_dataset>> datasets_;
+    std::vector<std::shared_ptr<storage_dataset>> datasets_;
 
 private:
     // RAII to handle recursive opening/closing groups
@@ -88,8 +123,8 @@ private:
     // name of group
     std::string name_;
 
-    // Handles group opening/closing
-    group_handle group_h_;
+    // Handles group opening/closing; null for groups held in memory
+    std::unique_ptr<group_handle> group_h_;
 };
 
 
@@ -136,7 +171,7 @@ public:
     h5_wrapper(const std::shared_ptr<h5_group>& g);
 
     // Returns number of sub-groups in the wrapped h5_group
-    int size();
+    int size() const;
 
     // Returns index of sub-group with name `name`; returns -1 if sub-group not found
     int find_group(std::string name) const;
@@ -144,6 +179,9 @@ public:
     // Returns index of dataset with name `name`; returns -1 if dataset not found
     int find_dataset(std::string name) const;
 
+    // Returns the names of the datasets in the wrapped h5_group
+    std::vector<std::string> dataset_names() const;
+
     // Returns size of dataset with name `name`; returns -1 if dataset not found
     int dataset_size(std::string name) const;
 
@@ -165,6 +203,9 @@ public:
     // Returns int pair at index i of dataset with name `name`; throws exception if dataset not found
     std::pair<int, int> int_pair_at(std::string name, unsigned i) const;
 
+    // Returns int pairs between indices i and j of dataset with name `name`; throws exception if dataset not found
+    std::vector<std::pair<int, int>> int_pair_range(std::string name, unsigned i, unsigned j) const;
+
     // Returns full content of 1D dataset with name `name`; throws exception if dataset not found
     std::vector<int> int_1d(std::string name) const;
 
@@ -177,6 +218,9 @@ public:
     // Returns name of the wrapped h5_group
     std::string name() const ;
 
+    // Returns the wrapped h5_group
+    const std::shared_ptr<h5_group>& group() const;
+
 private:
     // Pointer to the h5_group wrapped in h5_wrapper
     std::shared_ptr<h5_group> ptr_;
@@ -196,8 +240,12 @@ class h5_record {
 public:
     h5_record(const std::vector<std::shared_ptr<h5_file>>& files);
 
+    // Record of the populations `populations`, which are not necessarily backed by hdf5 files
+    h5_record(const std::vector<std::shared_ptr<h5_group>>& populations);
+
     // Verifies that the hdf5 files contain sonata edge information
-    bool verify_edges();
+    // Populations may lack the indicies group if `require_indices` is false, see edge_index.hpp
+    bool verify_edges(bool require_indices = true);
 
     // Verifies that the hdf5 files contain sonata node information
     bool verify_nodes();
@@ -223,7 +271,23 @@ public:
     // Returns names of all populations_
     std::vector<std::string> pop_names() const;
 
+    // Returns names of the hdf5 files of the record
+    std::vector<std::string> file_names() const;
+
+    // Returns name of the hdf5 file of the population at index `i`; empty if it is not backed by a file
+    std::string file_name(unsigned i) const;
+
+    // Adds group `group` to the population at index `i`, in memory: the population is replaced in this
+    // record only, and the files and the groups shared with other records are left untouched
+    void add_group(unsigned i, const std::shared_ptr<h5_group>& group);
+
+    // Returns the id in population_names of the population at index `i` in populations_
+    unsigned pop_id(unsigned i) const;
+
 private:
+    // Appends population `g` of file `file` to populations_
+    void add_population(const std::shared_ptr<h5_group>& g, const std::string& file);
+
     // Total number of nodes/ edges
     int num_elements_ = 0;
 
@@ -233,6 +297,12 @@ private:
     // Population names
     std::vector<std::string> pop_names_;
 
+    // Name of the file of every population
+    std::vector<std::string> pop_files_;
+
+    // Interned population names, see population_names
+    std::vector<unsigned> pop_ids_;
+
     // Partitioned sizes of the populations
     std::vector<unsigned> partition_;
 
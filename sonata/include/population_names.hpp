@@ -0,0 +1,45 @@
+#pragma once
+
+#include <deque>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+
+/// Dense ids of population names, shared by every h5_record and csv_record of the process
+/// Ids are assigned in order of first use, so lookups keyed on a population can compare integers
+class population_names {
+public:
+    // Returns the id of population `name`, assigning the next free id to new names
+    static unsigned intern(const std::string& name) {
+        auto& t = table();
+        std::lock_guard<std::mutex> lock(t.mtx);
+
+        auto it = t.ids.find(name);
+        if (it == t.ids.end()) {
+            it = t.ids.insert({name, (unsigned)t.names.size()}).first;
+            t.names.push_back(name);
+        }
+        return it->second;
+    }
+
+    // Returns the name of population `id`
+    static const std::string& name(unsigned id) {
+        auto& t = table();
+        std::lock_guard<std::mutex> lock(t.mtx);
+        return t.names.at(id);
+    }
+
+private:
+    struct intern_table {
+        std::mutex mtx;
+        std::unordered_map<std::string, unsigned> ids;
+
+        // A deque, so that references returned by name() stay valid
+        std::deque<std::string> names;
+    };
+
+    static intern_table& table() {
+        static intern_table t;
+        return t;
+    }
+};
@@ -0,0 +1,134 @@
+#pragma once
+
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "circuit_source.hpp"
+
+/// Dataset whose elements are computed on demand from their index; nothing is stored
+/// Scalar datasets provide the int and double accessors, pair datasets the int pair accessors
+class generated_dataset: public storage_dataset {
+public:
+    using scalar_fn = std::function<double(unsigned)>;
+    using pair_fn = std::function<std::pair<int, int>(unsigned)>;
+
+    static std::shared_ptr<generated_dataset> scalars(std::string name, unsigned size, scalar_fn f) {
+        return std::shared_ptr<generated_dataset>(new generated_dataset(std::move(name), size, std::move(f), nullptr));
+    }
+
+    static std::shared_ptr<generated_dataset> pairs(std::string name, unsigned size, pair_fn f) {
+        return std::shared_ptr<generated_dataset>(new generated_dataset(std::move(name), size, nullptr, std::move(f)));
+    }
+
+    std::string name() override;
+    int size() override;
+    int int_at(const int i) override;
+    double double_at(const int i) override;
+    int string_at(const int i) override;
+    std::vector<int> int_range(const int i, const int j) override;
+    std::vector<double> double_range(const int i, const int j) override;
+    std::pair<int, int> int_pair_at(const int i) override;
+    std::vector<std::pair<int, int>> int_pair_range(const int i, const int j) override;
+    std::vector<int> int_1d() override;
+    std::vector<std::pair<int, int>> int_2d() override;
+
+private:
+    generated_dataset(std::string name, unsigned size, scalar_fn scalar, pair_fn pair):
+        name_(std::move(name)), size_(size), scalar_(std::move(scalar)), pair_(std::move(pair)) {}
+
+    // Throws if [i, j) is not within the dataset, or if the dataset doesn't hold the requested kind of element
+    void check_scalar(int i, int j) const;
+    void check_pair(int i, int j) const;
+
+    std::string name_;
+    unsigned size_;
+    scalar_fn scalar_;
+    pair_fn pair_;
+};
+
+/// Population of identical cells
+struct procedural_population {
+    std::string name;
+    unsigned size;
+
+    // Node type: "virtual" cells are spike sources, other cells need a morphology and a model template
+    std::string model_type = "virtual";
+    std::string morphology = "NULL";
+    std::string model_template = "NULL";
+    std::string dynamics_params = "NULL";
+};
+
+/// Edges from population `source` to population `target`, with a fixed in-degree
+/// Every target cell t receives one edge per slot j < in_degree, from source cell
+/// (t*num_sources/num_targets + offset_j) % num_sources, where offset_j is drawn from the seed.
+/// The sources of every slot are spread over the whole source population, and both edge indices
+/// can be computed from the rule, so no edge is ever stored
+struct procedural_projection {
+    std::string name;
+    std::string source;
+    std::string target;
+    unsigned in_degree;
+
+    // Edge type
+    std::string model_template = "expsyn";
+    std::string dynamics_params = "NULL";
+    double weight = 0;
+    double delay = 1;
+    unsigned afferent_section = 0;
+    double afferent_position = 0.5;
+    unsigned efferent_section = 0;
+    double efferent_position = 0.5;
+
+    // Attributes that vary per edge, such as "nsyns" or "syn_weight": datasets of the edge group, which
+    // override the edge type. The value of an attribute for edge e of the projection is computed as f(e)
+    std::vector<std::pair<std::string, std::function<double(unsigned)>>> edge_attributes;
+};
+
+/// Regular input spike trains: every cell of `population` spikes `count` times, `interval` apart,
+/// starting at `start` plus a phase drawn from the seed in [0, interval)
+struct procedural_spikes {
+    std::string population;
+    double start = 0;
+    double interval = 10;
+    unsigned count = 1;
+};
+
+struct procedural_params {
+    std::vector<procedural_population> populations;
+    std::vector<procedural_projection> projections;
+    std::vector<procedural_spikes> spikes;
+    std::uint64_t seed = 0;
+};
+
+/// Circuit generated in memory from a procedural_params, for benchmarks at any scale
+/// Edges are sorted by slot then by target: edge j*num_targets + t is the edge of slot j of target t.
+/// Every population has a single node or edge type and a single group, which only holds the edge_attributes
+/// of projections, so other attributes come from the type tables. Populations, and their elements, must fit in an int
+class procedural_circuit: public circuit_source {
+public:
+    // Throws sonata_exception if the parameters are inconsistent
+    procedural_circuit(procedural_params params);
+
+    h5_record nodes() const override;
+    h5_record edges() const override;
+    csv_node_record node_types() const override;
+    csv_edge_record edge_types() const override;
+    std::vector<spike_info> spikes() const override;
+    std::vector<current_clamp_info> current_clamps() const override;
+    std::uint64_t content_hash() const override;
+
+    // Source cell of slot `slot` of target cell `target` in projection `proj`, as an index in the source population
+    unsigned source_of(unsigned proj, unsigned target, unsigned slot) const;
+
+private:
+    const procedural_population& population(const std::string& name) const;
+
+    procedural_params params_;
+
+    // Offset of every slot of every projection
+    std::vector<std::vector<unsigned>> offsets_;
+};
@@ -0,0 +1,42 @@
+#pragma once
+
+#include <cstddef>
+#include <memory>
+#include <vector>
+
+/// Read-only contiguous table of T
+/// The storage is either owned by the rank, or mapped from memory shared by all ranks on a node
+/// Copies of a shared_table refer to the same storage
+template <typename T>
+class shared_table {
+public:
+    shared_table() {}
+
+    // Table owned by the calling rank
+    explicit shared_table(std::vector<T> values) {
+        auto v = std::make_shared<std::vector<T>>(std::move(values));
+        data_ = v->data();
+        size_ = v->size();
+        owner_ = std::move(v);
+    }
+
+    // Table mapped from storage kept alive by `owner`
+    shared_table(const T* data, std::size_t size, std::shared_ptr<void> owner):
+        owner_(std::move(owner)), data_(data), size_(size) {}
+
+    const T* data() const { return data_; }
+    std::size_t size() const { return size_; }
+    bool empty() const { return size_ == 0; }
+
+    const T& operator[](std::size_t i) const { return data_[i]; }
+
+    const T* begin() const { return data_; }
+    const T* end() const { return data_ + size_; }
+
+private:
+    // Keeps the storage alive: a std::vector<T> or a shared memory window
+    std::shared_ptr<void> owner_;
+
+    const T* data_ = nullptr;
+    std::size_t size_ = 0;
+};
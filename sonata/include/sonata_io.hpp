@@ -19,14 +19,16 @@ struct network_params {
     h5_record edges;
     csv_edge_record edges_types;
 
+    // Edge populations may lack the indicies group if `require_indices` is false
     network_params(std::vector<h5_file_handle> nodes_h5,
                    std::vector<csv_file> nodes_csv,
                    std::vector<h5_file_handle> edges_h5,
-                   std::vector<csv_file> edges_csv):
+                   std::vector<csv_file> edges_csv,
+                   bool require_indices = true):
     nodes(nodes_h5), edges(edges_h5), nodes_types(nodes_csv), edges_types(edges_csv)
     {
         nodes.verify_nodes();
-        edges.verify_edges();
+        edges.verify_edges(require_indices);
     }
 
     network_params(network_params&& other)
@@ -73,6 +75,7 @@ struct sonata_params {
     std::vector<spike_info> spikes_input;
     spike_out_info spike_output;
     std::vector<probe_info> probes_info;
+    database_options db_options;
 
     sonata_params(network_params&& n,
                   sim_conditions&& s,
@@ -80,17 +83,19 @@ struct sonata_params {
                   std::vector<current_clamp_info>&& clamps,
                   std::vector<spike_info>&& spikes,
                   spike_out_info&& output,
-                  std::vector<probe_info>&& probes):
+                  std::vector<probe_info>&& probes,
+                  database_options&& opts):
     network(std::move(n)),
     conditions(std::move(s)),
     run(std::move(r)),
     current_clamps(std::move(clamps)),
     spikes_input(std::move(spikes)),
     spike_output(std::move(output)),
-    probes_info(std::move(probes)) {}
+    probes_info(std::move(probes)),
+    db_options(std::move(opts)) {}
 };
 
-network_params read_network_params(nlohmann::json network_json) {
+network_params read_network_params(nlohmann::json network_json, bool require_indices = true) {
     using sup::param_from_json;
 
     auto node_files = network_json["nodes"].get<std::vector<nlohmann::json>>();
@@ -135,7 +140,7 @@ network_params read_network_params(nlohmann::json network_json) {
         edges_csv.emplace_back(f);
     }
 
-    network_params params_network(nodes_h5, nodes_csv, edges_h5, edges_csv);
+    network_params params_network(nodes_h5, nodes_csv, edges_h5, edges_csv, require_indices);
 
     return params_network;
 }
@@ -163,6 +168,26 @@ run_params read_run_params(nlohmann::json run_json) {
     return run;
 }
 
+database_options read_database_options(nlohmann::json database_json) {
+    using sup::param_from_json;
+
+    database_options opts;
+
+    param_from_json(opts.shared_tables, "shared_tables", database_json);
+    param_from_json(opts.compact_edges, "compact_edges", database_json);
+    param_from_json(opts.resident_groups, "resident_groups", database_json);
+    param_from_json(opts.overlap_source_exchange, "overlap_source_exchange", database_json);
+    param_from_json(opts.circuit_cache, "circuit_cache", database_json);
+    param_from_json(opts.generate_edge_indices, "generate_edge_indices", database_json);
+    param_from_json(opts.index_threads, "index_threads", database_json);
+    param_from_json(opts.edge_index_cache, "edge_index_cache", database_json);
+    param_from_json(opts.coalesce_synapses, "coalesce_synapses", database_json);
+    param_from_json(opts.linear_synapses, "linear_synapses", database_json);
+    param_from_json(opts.order_targets, "order_targets", database_json);
+
+    return opts;
+}
+
 std::vector<current_clamp_info> read_clamps(std::unordered_map<std::string, nlohmann::json>& stim_json) {
     using sup::param_from_json;
     std::vector<current_clamp_info> ret;
@@ -260,6 +285,14 @@ sonata_params read_options(int argc, char** argv) {
     auto run_field = sim_json.find("run");
     run_params run(read_run_params(*run_field));
 
+    /// Database options
+    // Optional "database" field, tunes how the network is loaded and stored
+    database_options db_opts;
+    auto database_field = sim_json.find("database");
+    if (database_field != sim_json.end()) {
+        db_opts = read_database_options(*database_field);
+    }
+
     /// Network
     // Read circuit_config file name from the "network" field
     auto network_field = sim_json.find("network");
@@ -278,7 +311,7 @@ sonata_params read_options(int argc, char** argv) {
     auto circuit_config_map = circuit_json.get<std::unordered_map<std::string, nlohmann::json>>();
 
     // Read network parameters
-    network_params network(read_network_params(circuit_config_map["network"]));
+    network_params network(read_network_params(circuit_config_map["network"], !db_opts.generate_edge_indices));
 
     /// Inputs (stimuli)
     // Get json of inputs
@@ -302,7 +335,7 @@ sonata_params read_options(int argc, char** argv) {
     // Read report(probe) parameters
     auto probes = read_probes(reports_field, node_set_json);
 
-    sonata_params params(std::move(network), std::move(conditions), std::move(run), std::move(clamps), std::move(spikes), std::move(output), std::move(probes));
+    sonata_params params(std::move(network), std::move(conditions), std::move(run), std::move(clamps), std::move(spikes), std::move(output), std::move(probes), std::move(db_opts));
 
     return params;
 }
@@ -23,6 +23,7 @@
 #include "sonata_io.hpp"
 #include "sonata_cell.hpp"
 #include "data_management_lib.hpp"
+#include "procedural_circuit.hpp"
 
 #ifdef ARB_MPI_ENABLED
 #include <mpi.h>
@@ -40,15 +41,27 @@ using arb::cell_probe_address;
 class sonata_recipe: public arb::recipe {
 public:
     sonata_recipe(sonata_params params):
-            database_(params.network.nodes,
-                      params.network.edges,
-                      params.network.nodes_types,
-                      params.network.edges_types,
-                      params.spikes_input,
-                      params.current_clamps),
-            run_params_(params.run),
-            sim_cond_(params.conditions),
-            probe_info_(params.probes_info),
+            sonata_recipe(sonata_file_circuit(params.network.nodes,
+                                              params.network.edges,
+                                              params.network.nodes_types,
+                                              params.network.edges_types,
+                                              params.spikes_input,
+                                              params.current_clamps),
+                          params.conditions,
+                          params.run,
+                          params.probes_info,
+                          params.db_options) {}
+
+    // Recipe of a circuit from any storage backend, e.g. a procedural_circuit
+    sonata_recipe(const circuit_source& circuit,
+                  sim_conditions conditions,
+                  run_params run,
+                  std::vector<probe_info> probes,
+                  database_options opts):
+            database_(circuit, opts),
+            run_params_(run),
+            sim_cond_(conditions),
+            probe_info_(probes),
             num_cells_(database_.num_cells()) {}
 
     cell_size_type num_cells() const override {
@@ -57,7 +70,15 @@ public:
 
     void build_local_maps(const arb::domain_decomposition& decomp) {
         std::lock_guard<std::mutex> l(mtx_);
-        database_.build_source_and_target_maps(decomp.groups);
+        database_.build_local_maps(decomp.groups);
+        filter_local_probes(decomp);
+    }
+
+    // Frees the database state that is only needed to construct the simulation
+    // Call once arb::simulation is constructed; probes and outputs remain available
+    void release_build_state() {
+        std::lock_guard<std::mutex> l(mtx_);
+        database_.release_build_state();
     }
 
     arb::util::unique_any get_cell_description(cell_gid_type gid) const override {
@@ -87,14 +108,14 @@ public:
             return cell;
         }
         else if (get_cell_kind(gid) == cell_kind::spike_source) {
-            std::lock_guard<std::mutex> l(mtx_);
+            // Spike trains are read-only once the local maps are built
             std::vector<double> time_sequence = database_.get_spikes(gid);
             return arb::util::unique_any(arb::spike_source_cell{arb::explicit_schedule(time_sequence)});
         }
     }
 
     cell_kind get_cell_kind(cell_gid_type gid) const override {
-        std::lock_guard<std::mutex> l(mtx_);
+        // The cell kind table is read-only after construction
         return database_.get_cell_kind(gid);
     }
 
@@ -189,7 +210,42 @@ public:
         return database_.pop_names();
     }
 
+    edge_precision_report get_edge_precision() const {
+        return database_.edge_precision();
+    }
+
 private:
+    // Keeps only the probes on cells of this rank, and only the local node ids of their node sets
+    // A probe without node ids covers its whole population and is kept as is
+    void filter_local_probes(const arb::domain_decomposition& decomp) {
+        auto names = database_.pop_names();
+        auto partitions = database_.pop_partitions();
+
+        std::vector<probe_info> local_probes;
+        for (auto& p: probe_info_) {
+            auto pop = std::find(names.begin(), names.end(), p.population) - names.begin();
+            if (pop == (long)names.size()) {
+                continue;
+            }
+            if (p.node_ids.empty()) {
+                local_probes.push_back(std::move(p));
+                continue;
+            }
+
+            std::vector<unsigned> local_ids;
+            for (auto id: p.node_ids) {
+                if (decomp.gid_domain(partitions[pop] + id) == decomp.domain_id) {
+                    local_ids.push_back(id);
+                }
+            }
+            if (!local_ids.empty()) {
+                p.node_ids = std::move(local_ids);
+                local_probes.push_back(std::move(p));
+            }
+        }
+        probe_info_ = std::move(local_probes);
+    }
+
     mutable std::mutex mtx_;
     mutable database database_;
 
@@ -1,27 +1,35 @@
 #pragma once
 
+#include <algorithm>
+#include <climits>
+#include <cstddef>
+#include <initializer_list>
+#include <memory>
 #include <type_traits>
 #include <vector>
 #include <numeric>
 
 #include <mpi.h>
 
+#include "include/common_structs.hpp"
+#include "include/shared_table.hpp"
+
 #define MPI_OR_THROW(fn, ...)\
 while (int r_ = fn(__VA_ARGS__)) throw sonata_exception("MPI error");
 
-int rank(MPI_Comm comm) {
+inline int rank(MPI_Comm comm) {
     int r;
     MPI_OR_THROW(MPI_Comm_rank, comm, &r);
     return r;
 }
 
-int size(MPI_Comm comm) {
+inline int size(MPI_Comm comm) {
     int s;
     MPI_OR_THROW(MPI_Comm_size, comm, &s);
     return s;
 }
 
-void barrier(MPI_Comm comm) {
+inline void barrier(MPI_Comm comm) {
     MPI_OR_THROW(MPI_Barrier, comm);
 }
 
@@ -57,6 +65,28 @@ MAKE_TRAITS(unsigned long,      MPI_UNSIGNED_LONG)
 MAKE_TRAITS(long long,          MPI_LONG_LONG)
 MAKE_TRAITS(unsigned long long, MPI_UNSIGNED_LONG_LONG)
 
+// Derived datatype for source_type, so that only the fields (not the padding) are sent
+template <>
+struct mpi_traits<source_type> {
+    constexpr static size_t count() { return 1; }
+    static MPI_Datatype mpi_type() {
+        static MPI_Datatype type = [] {
+            int lengths[] = {1, 1};
+            MPI_Aint displs[] = {offsetof(source_type, segment), offsetof(source_type, position)};
+            MPI_Datatype types[] = {mpi_traits<cell_lid_type>::mpi_type(), MPI_DOUBLE};
+
+            MPI_Datatype fields, t;
+            MPI_OR_THROW(MPI_Type_create_struct, 2, lengths, displs, types, &fields);
+            MPI_OR_THROW(MPI_Type_create_resized, fields, 0, sizeof(source_type), &t);
+            MPI_OR_THROW(MPI_Type_commit, &t);
+            MPI_OR_THROW(MPI_Type_free, &fields);
+            return t;
+        }();
+        return type;
+    }
+    constexpr static bool is_mpi_native_type() { return false; }
+};
+
 static_assert(std::is_same<std::size_t, unsigned long>::value ||
               std::is_same<std::size_t, unsigned long long>::value,
               "size_t is not the same as unsigned long or unsigned long long");
@@ -89,21 +119,328 @@ std::vector<T> gather_all(T value, MPI_Comm comm) {
 }
 
 template <typename T>
-std::vector<T> gather_all(const std::vector<T>& values, MPI_Comm comm) {
+T min_all(T value, MPI_Comm comm) {
+    using traits = mpi_traits<T>;
+    static_assert(traits::is_mpi_native_type(), "min_all requires a native MPI type");
+
+    MPI_OR_THROW(MPI_Allreduce, MPI_IN_PLACE, &value, 1, traits::mpi_type(), MPI_MIN, comm);
+    return value;
+}
 
+template <typename T>
+T sum_all(T value, MPI_Comm comm) {
     using traits = mpi_traits<T>;
-    auto counts = gather_all(int(values.size()), comm);
-    for (auto& c : counts) {
-        c *= traits::count();
-    }
+    static_assert(traits::is_mpi_native_type(), "sum_all requires a native MPI type");
+
+    MPI_OR_THROW(MPI_Allreduce, MPI_IN_PLACE, &value, 1, traits::mpi_type(), MPI_SUM, comm);
+    return value;
+}
+
+template <typename T>
+T max_all(T value, MPI_Comm comm) {
+    using traits = mpi_traits<T>;
+    static_assert(traits::is_mpi_native_type(), "max_all requires a native MPI type");
+
+    MPI_OR_THROW(MPI_Allreduce, MPI_IN_PLACE, &value, 1, traits::mpi_type(), MPI_MAX, comm);
+    return value;
+}
+
+// Largest number of values of T that fit in the int counts of one MPI call
+template <typename T>
+constexpr std::size_t max_round() {
+    return INT_MAX/mpi_traits<T>::count();
+}
+
+// Runs a variable count exchange of `counts[i]` elements from every rank i, in calls to
+// `exchange(send, send_count, recv, recv_counts, recv_displs)` that take int counts.
+// Exchanges of more than `limit` values are split into rounds that each send at most
+// limit/num_ranks of them per rank; `receives` is false on ranks that get no data (non-root ranks of a gather)
+template <typename T, typename Exchange>
+void exchange_in_rounds(const T* send, std::size_t count, T* recv, const std::vector<std::size_t>& counts,
+                        bool receives, Exchange&& exchange, std::size_t limit = max_round<T>()) {
+    using traits = mpi_traits<T>;
+    limit = std::min(limit, max_round<T>());
+    const std::size_t n = counts.size();
+
     auto displs = make_index(counts);
+    std::vector<int> c(n), d(n);
 
-    std::vector<T> buffer(displs.back()/traits::count());
-    MPI_OR_THROW(MPI_Allgatherv,
-    // const_cast required for MPI implementations that don't use const* in their interfaces
-                 const_cast<T*>(values.data()), counts[rank(comm)], traits::mpi_type(),  // send buffer
-                 buffer.data(), counts.data(), displs.data(), traits::mpi_type(), // receive buffer
-                 comm);
+    if (displs.back() <= limit) {
+        for (std::size_t i = 0; i < n; i++) {
+            c[i] = counts[i]*traits::count();
+            d[i] = displs[i]*traits::count();
+        }
+        exchange(send, int(count*traits::count()), recv, c.data(), d.data());
+        return;
+    }
+
+    const std::size_t chunk = std::max<std::size_t>(limit/n, 1);
+    const std::size_t max_count = *std::max_element(counts.begin(), counts.end());
+    std::vector<T> tmp(receives ? chunk*n : 0);
+
+    for (std::size_t first = 0; first < max_count; first += chunk) {
+        int offset = 0;
+        for (std::size_t i = 0; i < n; i++) {
+            c[i] = counts[i] > first ? std::min(counts[i] - first, chunk)*traits::count() : 0;
+            d[i] = offset;
+            offset += c[i];
+        }
+
+        auto send_count = count > first ? std::min(count - first, chunk) : 0;
+        exchange(send + std::min(first, count), int(send_count*traits::count()), tmp.data(), c.data(), d.data());
+
+        if (receives) {
+            for (std::size_t i = 0; i < n; i++) {
+                auto from = tmp.data() + d[i]/traits::count();
+                std::copy(from, from + c[i]/traits::count(), recv + displs[i] + first);
+            }
+        }
+    }
+}
+
+// Gathers `count` values from every rank into `recv`, where rank i contributes `counts[i]` values
+// With MPI 4 the exchange is a single large count call, unless a round `limit` is given (see exchange_in_rounds)
+template <typename T>
+void allgatherv(const T* send, std::size_t count, T* recv, const std::vector<std::size_t>& counts, MPI_Comm comm,
+                std::size_t limit = max_round<T>()) {
+    using traits = mpi_traits<T>;
+#if MPI_VERSION >= 4
+    if (limit >= max_round<T>()) {
+        std::vector<MPI_Count> c(counts.size());
+        std::vector<MPI_Aint> d(counts.size());
+        MPI_Aint offset = 0;
+        for (std::size_t i = 0; i < counts.size(); i++) {
+            c[i] = counts[i]*traits::count();
+            d[i] = offset;
+            offset += c[i];
+        }
+        MPI_OR_THROW(MPI_Allgatherv_c,
+                     const_cast<T*>(send), MPI_Count(count*traits::count()), traits::mpi_type(), // send buffer
+                     recv, c.data(), d.data(), traits::mpi_type(),                               // receive buffer
+                     comm);
+        return;
+    }
+#endif
+    exchange_in_rounds(send, count, recv, counts, true,
+        [&](const T* s, int n, T* r, const int* c, const int* d) {
+            // const_cast required for MPI implementations that don't use const* in their interfaces
+            MPI_OR_THROW(MPI_Allgatherv,
+                         const_cast<T*>(s), n, traits::mpi_type(), // send buffer
+                         r, c, d, traits::mpi_type(),              // receive buffer
+                         comm);
+        }, limit);
+}
+
+// Gathers `count` values from every rank into `recv` on rank `root`, where rank i contributes `counts[i]` values
+// With MPI 4 the exchange is a single large count call, unless a round `limit` is given (see exchange_in_rounds)
+template <typename T>
+void gatherv(const T* send, std::size_t count, T* recv, const std::vector<std::size_t>& counts, int root, MPI_Comm comm,
+             std::size_t limit = max_round<T>()) {
+    using traits = mpi_traits<T>;
+#if MPI_VERSION >= 4
+    if (limit >= max_round<T>()) {
+        std::vector<MPI_Count> c(counts.size());
+        std::vector<MPI_Aint> d(counts.size());
+        MPI_Aint offset = 0;
+        for (std::size_t i = 0; i < counts.size(); i++) {
+            c[i] = counts[i]*traits::count();
+            d[i] = offset;
+            offset += c[i];
+        }
+        MPI_OR_THROW(MPI_Gatherv_c,
+                     const_cast<T*>(send), MPI_Count(count*traits::count()), traits::mpi_type(), // send buffer
+                     recv, c.data(), d.data(), traits::mpi_type(),                               // receive buffer
+                     root, comm);
+        return;
+    }
+#endif
+    exchange_in_rounds(send, count, recv, counts, rank(comm) == root,
+        [&](const T* s, int n, T* r, const int* c, const int* d) {
+            MPI_OR_THROW(MPI_Gatherv,
+                         const_cast<T*>(s), n, traits::mpi_type(), // send buffer
+                         r, c, d, traits::mpi_type(),              // receive buffer
+                         root, comm);
+        }, limit);
+}
+
+template <typename T>
+std::vector<T> gather_all(const std::vector<T>& values, MPI_Comm comm) {
+    auto counts = gather_all(values.size(), comm);
+
+    std::vector<T> buffer(make_index(counts).back());
+    allgatherv(values.data(), values.size(), buffer.data(), counts, comm);
 
     return buffer;
 }
+
+// Non-blocking gather_all: the exchange starts on construction, and wait() returns the values of all ranks
+// The exchange makes progress in calls to test(); the element counts are exchanged with a blocking call
+template <typename T>
+class pending_gather {
+public:
+    pending_gather(std::vector<T> values, MPI_Comm comm): send_(std::move(values)) {
+        using traits = mpi_traits<T>;
+        auto counts = gather_all(send_.size(), comm);
+        auto displs = make_index(counts);
+        buffer_.resize(displs.back());
+
+        for (std::size_t i = 0; i < counts.size(); i++) {
+            counts_.push_back(counts[i]*traits::count());
+            displs_.push_back(displs[i]*traits::count());
+        }
+#if MPI_VERSION >= 4
+        MPI_OR_THROW(MPI_Iallgatherv_c,
+                     send_.data(), MPI_Count(send_.size()*traits::count()), traits::mpi_type(), // send buffer
+                     buffer_.data(), counts_.data(), displs_.data(), traits::mpi_type(),       // receive buffer
+                     comm, &request_);
+#else
+        if (displs.back() > max_round<T>()) {
+            // Too large for int counts: exchanged in blocking rounds
+            allgatherv(send_.data(), send_.size(), buffer_.data(), counts, comm);
+            return;
+        }
+        MPI_OR_THROW(MPI_Iallgatherv,
+                     send_.data(), int(send_.size()*traits::count()), traits::mpi_type(), // send buffer
+                     buffer_.data(), counts_.data(), displs_.data(), traits::mpi_type(),  // receive buffer
+                     comm, &request_);
+#endif
+    }
+
+    pending_gather(const pending_gather&) = delete;
+    pending_gather& operator=(const pending_gather&) = delete;
+
+    // The buffers must outlive the exchange
+    ~pending_gather() {
+        if (request_ != MPI_REQUEST_NULL) {
+            MPI_Wait(&request_, MPI_STATUS_IGNORE);
+        }
+    }
+
+    // Returns true if the exchange is complete
+    bool test() {
+        int done;
+        MPI_OR_THROW(MPI_Test, &request_, &done, MPI_STATUS_IGNORE);
+        return done;
+    }
+
+    std::vector<T> wait() {
+        MPI_OR_THROW(MPI_Wait, &request_, MPI_STATUS_IGNORE);
+        return std::move(buffer_);
+    }
+
+private:
+    std::vector<T> send_;
+    std::vector<T> buffer_;
+#if MPI_VERSION >= 4
+    std::vector<MPI_Count> counts_;
+    std::vector<MPI_Aint> displs_;
+#else
+    std::vector<int> counts_;
+    std::vector<int> displs_;
+#endif
+    MPI_Request request_ = MPI_REQUEST_NULL;
+};
+
+// Communicators used to keep read-only tables in memory shared by the ranks of a node
+struct shared_comms {
+    // Ranks of MPI_COMM_WORLD that share memory with the calling rank
+    MPI_Comm node;
+
+    // The first rank of every node; MPI_COMM_NULL on all other ranks
+    MPI_Comm leaders;
+};
+
+// Splits MPI_COMM_WORLD by shared memory domain; collective on the first call
+inline const shared_comms& node_comms() {
+    static shared_comms comms = [] {
+        shared_comms c;
+        auto world_rank = rank(MPI_COMM_WORLD);
+        MPI_OR_THROW(MPI_Comm_split_type, MPI_COMM_WORLD, MPI_COMM_TYPE_SHARED, world_rank, MPI_INFO_NULL, &c.node);
+
+        int color = rank(c.node) == 0 ? 0 : MPI_UNDEFINED;
+        MPI_OR_THROW(MPI_Comm_split, MPI_COMM_WORLD, color, world_rank, &c.leaders);
+        return c;
+    }();
+    return comms;
+}
+
+// Allocates `n` elements of T in an MPI-3 shared window over `node`, returned in `win`
+// The first rank of `node` holds the memory and is the only one that should write to it, see write_node_shared
+// Collective over `node`; the window is freed (collectively) with the last copy of `owner`
+template <typename T>
+T* allocate_node_shared(std::size_t n, MPI_Comm node, std::shared_ptr<void>& owner, MPI_Win& win) {
+    static_assert(std::is_trivially_copyable<T>::value, "shared tables require trivially copyable types");
+
+    bool leader = rank(node) == 0;
+    MPI_Aint bytes = leader ? n*sizeof(T) : 0;
+
+    T* base = nullptr;
+    auto handle = new MPI_Win;
+    MPI_OR_THROW(MPI_Win_allocate_shared, bytes, sizeof(T), MPI_INFO_NULL, node, &base, handle);
+
+    if (!leader) {
+        MPI_Aint size;
+        int disp;
+        MPI_OR_THROW(MPI_Win_shared_query, *handle, 0, &size, &disp, &base);
+    }
+
+    win = *handle;
+    owner = std::shared_ptr<void>(handle, [](void* w) {
+        MPI_Win_free(static_cast<MPI_Win*>(w));
+        delete static_cast<MPI_Win*>(w);
+    });
+    return base;
+}
+
+// Runs `write()` on the first rank of `node` to fill the shared windows `wins`, and makes the result visible
+// to every rank of `node`. The write happens in a passive target epoch, and the windows are synchronised
+// on both sides of a barrier, as the separate memory model of MPI-3 requires. Collective over `node`
+template <typename Write>
+void write_node_shared(std::initializer_list<MPI_Win> wins, MPI_Comm node, Write&& write) {
+    for (auto w: wins) {
+        MPI_OR_THROW(MPI_Win_lock_all, MPI_MODE_NOCHECK, w);
+    }
+    if (rank(node) == 0) {
+        write();
+    }
+    for (auto w: wins) {
+        MPI_OR_THROW(MPI_Win_sync, w);
+    }
+    barrier(node);
+    for (auto w: wins) {
+        MPI_OR_THROW(MPI_Win_sync, w);
+        MPI_OR_THROW(MPI_Win_unlock_all, w);
+    }
+}
+
+// Gathers `values` from every rank of MPI_COMM_WORLD into memory shared by the ranks of a node
+// Values are ordered by node, then by rank within the node: the order is the same for every call,
+// but not necessarily the MPI_COMM_WORLD rank order used by gather_all
+template <typename T>
+shared_table<T> gather_all_shared(const std::vector<T>& values, const shared_comms& comms) {
+    bool leader = comms.leaders != MPI_COMM_NULL;
+
+    // Collect the values of the node on the leader
+    auto node_counts = gather_all(values.size(), comms.node);
+    std::vector<T> node_values(leader ? make_index(node_counts).back() : 0);
+    gatherv(values.data(), values.size(), node_values.data(), node_counts, 0, comms.node);
+
+    // Exchange between leaders, straight into the shared window
+    std::vector<std::size_t> counts;
+    std::size_t total = 0;
+    if (leader) {
+        counts = gather_all(node_values.size(), comms.leaders);
+        total = make_index(counts).back();
+    }
+    MPI_OR_THROW(MPI_Bcast, &total, 1, mpi_traits<std::size_t>::mpi_type(), 0, comms.node);
+
+    std::shared_ptr<void> owner;
+    MPI_Win win;
+    T* base = allocate_node_shared<T>(total, comms.node, owner, win);
+
+    write_node_shared({win}, comms.node, [&] {
+        allgatherv(node_values.data(), node_values.size(), base, counts, comms.leaders);
+    });
+
+    return shared_table<T>(base, total, std::move(owner));
+}
@@ -0,0 +1,322 @@
+#include <arbor/common_types.hpp>
+#include <arbor/cable_cell.hpp>
+
+#include <climits>
+#include <iomanip>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include "include/sonata_exceptions.hpp"
+#include "include/flat_hash_map.hpp"
+#include "include/procedural_circuit.hpp"
+
+///generated_dataset methods
+
+std::string generated_dataset::name() {
+    return name_;
+}
+
+int generated_dataset::size() {
+    return size_;
+}
+
+void generated_dataset::check_scalar(int i, int j) const {
+    if (!scalar_ || i < 0 || j < i || (unsigned)j > size_) {
+        throw sonata_dataset_exception(name_, (unsigned)i, (unsigned)j);
+    }
+}
+
+void generated_dataset::check_pair(int i, int j) const {
+    if (!pair_ || i < 0 || j < i || (unsigned)j > size_) {
+        throw sonata_dataset_exception(name_, (unsigned)i, (unsigned)j);
+    }
+}
+
+int generated_dataset::int_at(const int i) {
+    check_scalar(i, i + 1);
+    return (int)scalar_(i);
+}
+
+double generated_dataset::double_at(const int i) {
+    check_scalar(i, i + 1);
+    return scalar_(i);
+}
+
+int generated_dataset::string_at(const int i) {
+    return int_at(i);
+}
+
+std::vector<int> generated_dataset::int_range(const int i, const int j) {
+    check_scalar(i, j);
+    std::vector<int> out;
+    out.reserve(j - i);
+    for (int k = i; k < j; k++) {
+        out.push_back((int)scalar_(k));
+    }
+    return out;
+}
+
+std::vector<double> generated_dataset::double_range(const int i, const int j) {
+    check_scalar(i, j);
+    std::vector<double> out;
+    out.reserve(j - i);
+    for (int k = i; k < j; k++) {
+        out.push_back(scalar_(k));
+    }
+    return out;
+}
+
+std::pair<int, int> generated_dataset::int_pair_at(const int i) {
+    check_pair(i, i + 1);
+    return pair_(i);
+}
+
+std::vector<std::pair<int, int>> generated_dataset::int_pair_range(const int i, const int j) {
+    check_pair(i, j);
+    std::vector<std::pair<int, int>> out;
+    out.reserve(j - i);
+    for (int k = i; k < j; k++) {
+        out.push_back(pair_(k));
+    }
+    return out;
+}
+
+std::vector<int> generated_dataset::int_1d() {
+    return int_range(0, size_);
+}
+
+std::vector<std::pair<int, int>> generated_dataset::int_2d() {
+    return int_pair_range(0, size_);
+}
+
+///procedural_circuit methods
+
+namespace {
+// Doubles are written with all their digits, they are parsed back by the csv records
+std::string to_field(double v) {
+    std::ostringstream o;
+    o << std::setprecision(17) << v;
+    return o.str();
+}
+
+std::shared_ptr<h5_group> empty_group(std::string name) {
+    return std::make_shared<h5_group>(std::move(name),
+                                      std::vector<std::shared_ptr<h5_group>>(),
+                                      std::vector<std::shared_ptr<storage_dataset>>());
+}
+
+std::shared_ptr<h5_group> make_group(std::string name,
+                                     std::vector<std::shared_ptr<h5_group>> groups,
+                                     std::vector<std::shared_ptr<storage_dataset>> datasets) {
+    return std::make_shared<h5_group>(std::move(name), std::move(groups), std::move(datasets));
+}
+}
+
+procedural_circuit::procedural_circuit(procedural_params params): params_(std::move(params)) {
+    for (auto& p: params_.populations) {
+        if (p.size > INT_MAX) {
+            throw sonata_exception(pprintf("Procedural population {} is too large", p.name));
+        }
+    }
+
+    for (unsigned i = 0; i < params_.projections.size(); i++) {
+        auto& proj = params_.projections[i];
+        std::uint64_t num_sources = population(proj.source).size;
+        std::uint64_t num_targets = population(proj.target).size;
+
+        if (!num_sources && num_targets && proj.in_degree) {
+            throw sonata_exception(pprintf("Projection {} has no source cells", proj.name));
+        }
+        if (proj.in_degree*num_targets > INT_MAX || proj.in_degree*num_sources > INT_MAX) {
+            throw sonata_exception(pprintf("Projection {} has too many edges", proj.name));
+        }
+
+        std::vector<unsigned> offsets;
+        for (unsigned j = 0; j < proj.in_degree; j++) {
+            auto h = hash_combine(hash_combine(mix_hash(params_.seed), i), j);
+            offsets.push_back(num_sources ? h % num_sources : 0);
+        }
+        offsets_.push_back(std::move(offsets));
+    }
+
+    for (auto& s: params_.spikes) {
+        if ((std::uint64_t)population(s.population).size*s.count > INT_MAX) {
+            throw sonata_exception(pprintf("Too many input spikes in population {}", s.population));
+        }
+    }
+}
+
+const procedural_population& procedural_circuit::population(const std::string& name) const {
+    for (auto& p: params_.populations) {
+        if (p.name == name) {
+            return p;
+        }
+    }
+    throw sonata_exception(pprintf("Unknown procedural population {}", name));
+}
+
+unsigned procedural_circuit::source_of(unsigned proj, unsigned target, unsigned slot) const {
+    auto& p = params_.projections[proj];
+    std::uint64_t num_sources = population(p.source).size;
+    std::uint64_t num_targets = population(p.target).size;
+    return (target*num_sources/num_targets + offsets_[proj][slot]) % num_sources;
+}
+
+h5_record procedural_circuit::nodes() const {
+    std::vector<std::shared_ptr<h5_group>> pops;
+    for (auto& p: params_.populations) {
+        auto zero = [](unsigned) { return 0.; };
+        auto identity = [](unsigned i) { return double(i); };
+
+        pops.push_back(make_group(p.name, {empty_group("0")}, {
+            generated_dataset::scalars("node_type_id", p.size, zero),
+            generated_dataset::scalars("node_group_id", p.size, zero),
+            generated_dataset::scalars("node_group_index", p.size, identity)}));
+    }
+    return h5_record(pops);
+}
+
+h5_record procedural_circuit::edges() const {
+    std::vector<std::shared_ptr<h5_group>> pops;
+    for (unsigned i = 0; i < params_.projections.size(); i++) {
+        auto& proj = params_.projections[i];
+        std::uint64_t ns = population(proj.source).size;
+        std::uint64_t nt = population(proj.target).size;
+        unsigned k = proj.in_degree;
+        unsigned num_edges = k*nt;
+
+        auto zero = [](unsigned) { return 0.; };
+        auto identity = [](unsigned e) { return double(e); };
+        auto target = [nt](unsigned e) { return double(e % nt); };
+
+        // Copy of the offsets, the datasets may outlive the circuit
+        auto offsets = offsets_[i];
+        auto source = [ns, nt, offsets](unsigned e) {
+            return double(((e % nt)*ns/nt + offsets[e/nt]) % ns);
+        };
+
+        // target_to_source: target t has one range per slot, each of a single edge
+        auto t2s_ranges = [k](unsigned t) { return std::make_pair(int(t*k), int((t + 1)*k)); };
+        auto t2s_edges = [k, nt](unsigned r) {
+            int e = r%k*nt + r/k;
+            return std::make_pair(e, e + 1);
+        };
+
+        // source_to_target: source s has one range per slot, holding the contiguous block of
+        // targets t with t*ns/nt == (s - offset) % ns
+        auto s2t_ranges = [k](unsigned s) { return std::make_pair(int(s*k), int((s + 1)*k)); };
+        auto s2t_edges = [k, ns, nt, offsets](unsigned r) {
+            std::uint64_t s = r/k, j = r%k;
+            auto b = (s + ns - offsets[j]) % ns;
+            auto first = (b*nt + ns - 1)/ns;
+            auto last = ((b + 1)*nt + ns - 1)/ns;
+            return std::make_pair(int(j*nt + first), int(j*nt + last));
+        };
+
+        auto indices = make_group("indicies", {
+            make_group("source_to_target", {}, {
+                generated_dataset::pairs("node_id_to_ranges", ns, s2t_ranges),
+                generated_dataset::pairs("range_to_edge_id", ns*k, s2t_edges)}),
+            make_group("target_to_source", {}, {
+                generated_dataset::pairs("node_id_to_ranges", nt, t2s_ranges),
+                generated_dataset::pairs("range_to_edge_id", nt*k, t2s_edges)})}, {});
+
+        std::vector<std::shared_ptr<storage_dataset>> attributes;
+        for (auto& a: proj.edge_attributes) {
+            attributes.push_back(generated_dataset::scalars(a.first, num_edges, a.second));
+        }
+
+        pops.push_back(make_group(proj.name, {make_group("0", {}, std::move(attributes)), indices}, {
+            generated_dataset::scalars("edge_type_id", num_edges, zero),
+            generated_dataset::scalars("edge_group_id", num_edges, zero),
+            generated_dataset::scalars("edge_group_index", num_edges, identity),
+            generated_dataset::scalars("source_node_id", num_edges, source),
+            generated_dataset::scalars("target_node_id", num_edges, target)}));
+    }
+    return h5_record(pops);
+}
+
+csv_node_record procedural_circuit::node_types() const {
+    std::vector<std::vector<std::string>> rows = {
+        {"node_type_id", "pop_name", "model_type", "model_template", "morphology", "dynamics_params"}};
+    for (auto& p: params_.populations) {
+        rows.push_back({"0", p.name, p.model_type, p.model_template, p.morphology, p.dynamics_params});
+    }
+    return csv_node_record({csv_file("procedural_node_types", std::move(rows))});
+}
+
+csv_edge_record procedural_circuit::edge_types() const {
+    std::vector<std::vector<std::string>> rows = {
+        {"edge_type_id", "pop_name", "source_pop_name", "target_pop_name", "model_template", "dynamics_params",
+         "delay", "syn_weight", "afferent_section_id", "afferent_section_pos", "efferent_section_id", "efferent_section_pos"}};
+    for (auto& p: params_.projections) {
+        rows.push_back({"0", p.name, p.source, p.target, p.model_template, p.dynamics_params,
+                        to_field(p.delay), to_field(p.weight),
+                        std::to_string(p.afferent_section), to_field(p.afferent_position),
+                        std::to_string(p.efferent_section), to_field(p.efferent_position)});
+    }
+    return csv_edge_record({csv_file("procedural_edge_types", std::move(rows))});
+}
+
+std::vector<spike_info> procedural_circuit::spikes() const {
+    std::vector<spike_info> out;
+    for (unsigned i = 0; i < params_.spikes.size(); i++) {
+        auto& s = params_.spikes[i];
+        unsigned n = population(s.population).size;
+        unsigned count = s.count;
+
+        auto seed = hash_combine(mix_hash(params_.seed), params_.projections.size() + i);
+        auto ranges = [count](unsigned cell) { return std::make_pair(int(cell*count), int((cell + 1)*count)); };
+        auto times = [s, seed](unsigned k) {
+            auto cell = k/s.count;
+            double phase = (hash_combine(seed, cell) % 1024)/1024.*s.interval;
+            return s.start + phase + (k % s.count)*s.interval;
+        };
+
+        auto top = make_group("/", {make_group("spikes", {}, {
+            generated_dataset::pairs("gid_to_range", n, ranges),
+            generated_dataset::scalars("timestamps", n*count, times)})}, {});
+        out.push_back({h5_wrapper(top), s.population});
+    }
+    return out;
+}
+
+std::vector<current_clamp_info> procedural_circuit::current_clamps() const {
+    return {};
+}
+
+std::uint64_t procedural_circuit::content_hash() const {
+    auto h = hash_string("procedural_circuit", 0xcbf29ce484222325ull);
+    auto number = [&](double v) { h = hash_bytes(&v, sizeof(v), h); };
+
+    h = hash_bytes(&params_.seed, sizeof(params_.seed), h);
+    for (auto& p: params_.populations) {
+        h = hash_string(p.name, h);
+        number(p.size);
+        h = hash_string(p.model_type, h);
+        h = hash_file_contents(p.morphology, h);
+        h = hash_file_contents(p.model_template, h);
+        h = hash_file_contents(p.dynamics_params, h);
+    }
+    for (auto& p: params_.projections) {
+        h = hash_string(p.name, h);
+        h = hash_string(p.source, h);
+        h = hash_string(p.target, h);
+        number(p.in_degree);
+        h = hash_string(p.model_template, h);
+        h = hash_file_contents(p.dynamics_params, h);
+        for (double v: {p.weight, p.delay, double(p.afferent_section), p.afferent_position,
+                        double(p.efferent_section), p.efferent_position}) {
+            number(v);
+        }
+        unsigned num_edges = p.in_degree*population(p.target).size;
+        for (auto& a: p.edge_attributes) {
+            h = hash_string(a.first, h);
+            for (unsigned e = 0; e < num_edges; e++) {
+                number(a.second(e));
+            }
+        }
+    }
+    return h;
+}
@@ -1,8 +1,21 @@
+#include <arbor/version.hpp>
+
 #include <iostream>
 
+#ifdef ARB_MPI_ENABLED
+#include <mpi.h>
+#endif
+
 #include "../gtest.h"
 
 int main(int argc, char **argv) {
+#ifdef ARB_MPI_ENABLED
+    MPI_Init(&argc, &argv);
+#endif
     ::testing::InitGoogleTest(&argc, argv);
-    return RUN_ALL_TESTS();
+    int result = RUN_ALL_TESTS();
+#ifdef ARB_MPI_ENABLED
+    MPI_Finalize();
+#endif
+    return result;
 }
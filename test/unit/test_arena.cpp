@@ -0,0 +1,46 @@
+#include <cstdint>
+
+#include "arena.hpp"
+
+#include "../gtest.h"
+
+TEST(arena, rewind) {
+    monotonic_arena arena(256);
+
+    auto a = arena.allocate(10, 1);
+    auto m = arena.position();
+    auto b = arena.allocate(8, 8);
+    EXPECT_EQ(0u, reinterpret_cast<std::uintptr_t>(b) % 8);
+    EXPECT_NE(a, b);
+
+    // Memory after the mark is handed out again
+    arena.rewind(m);
+    EXPECT_EQ(b, arena.allocate(8, 8));
+
+    // Requests larger than a block get their own block
+    arena.allocate(1000, 8);
+    EXPECT_EQ(256u + 1000u, arena.capacity());
+
+    arena.release();
+    EXPECT_EQ(0u, arena.capacity());
+}
+
+TEST(arena, scoped_vector) {
+    monotonic_arena arena(1024);
+
+    for (unsigned i = 0; i < 10; i++) {
+        arena_scope scope(arena);
+        arena_vector<unsigned> v(arena);
+        for (unsigned j = 0; j < 100; j++) {
+            v.push_back(i*j);
+        }
+        EXPECT_EQ(99*i, v.back());
+    }
+    // Every iteration reuses the blocks of the first one
+    auto capacity = arena.capacity();
+    {
+        arena_scope scope(arena);
+        arena_vector<unsigned> v(100, 1, arena);
+    }
+    EXPECT_EQ(capacity, arena.capacity());
+}
@@ -0,0 +1,50 @@
+#include <arbor/cable_cell.hpp>
+
+#include <string>
+
+#include "circuit_image.hpp"
+
+#include "../gtest.h"
+
+TEST(circuit_image, synapses) {
+    synapse_table table;
+    arb::mechanism_desc a("expsyn");
+    a.set("tau", 2.5);
+    a.set("e", -70);
+    table.intern(a);
+    table.intern(arb::mechanism_desc("exp2syn"));
+
+    auto text = write_synapses(table);
+    auto descs = read_synapses(text.data(), text.size());
+    ASSERT_EQ(2u, descs.size());
+
+    // The descriptions read back intern to the same ids
+    for (unsigned i = 0; i < descs.size(); i++) {
+        EXPECT_EQ(i, table.intern(descs[i]));
+    }
+    EXPECT_EQ(2u, table.size());
+}
+
+TEST(circuit_image, layout) {
+    auto h = make_image_header(42);
+    h.num_cells = 3;
+    h.num_sources = 5;
+    h.num_incoming = 7;
+    h.synapse_bytes = 11;
+
+    image_layout l(h);
+    for (auto offset: {l.cell_kinds, l.cells, l.source_divs, l.sources, l.targets, l.target_edges, l.connections, l.synapses}) {
+        EXPECT_EQ(0u, offset % 64);
+    }
+    EXPECT_LE(sizeof(image_header), l.cell_kinds);
+    EXPECT_LE(l.connections + 7*sizeof(image_connection), l.synapses);
+    EXPECT_EQ(l.synapses + 11, l.size);
+
+    // The compact sources take less room
+    h.compact_sources = 1;
+    EXPECT_GE(l.targets, image_layout(h).targets);
+}
+
+TEST(circuit_image, missing) {
+    EXPECT_EQ(nullptr, circuit_image::open("/nonexistent/circuit.img", 42, 3));
+}
@@ -1,5 +1,15 @@
 #include <arbor/cable_cell.hpp>
 
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <stdexcept>
+#include <string>
+#include <type_traits>
+#include <vector>
+
+#include <unistd.h>
+
 #include "csv_lib.hpp"
 #include "sonata_exceptions.hpp"
 
@@ -27,6 +37,149 @@ TEST(csv_file, constructor) {
     }
 }
 
+namespace {
+// Empty file of a unique name in the temporary directory, removed with the guard
+struct temp_file {
+    std::string path;
+
+    temp_file(const std::string& prefix) {
+        const char* dir = std::getenv("TMPDIR");
+        auto pattern = std::string(dir && *dir ? dir : "/tmp") + "/" + prefix + "_XXXXXX";
+        std::vector<char> name(pattern.begin(), pattern.end());
+        name.push_back(0);
+
+        int fd = mkstemp(name.data());
+        if (fd == -1) {
+            throw std::runtime_error("Unable to create a temporary file " + pattern);
+        }
+        close(fd);
+        path = name.data();
+    }
+
+    temp_file(const temp_file&) = delete;
+    temp_file& operator=(const temp_file&) = delete;
+
+    ~temp_file() {
+        std::remove(path.c_str());
+    }
+};
+} // namespace
+
+TEST(csv_view, delimiters) {
+    temp_file file("csv_view_test");
+    {
+        std::ofstream f(file.path);
+        f << "id  name value\r\n" << "\n" << " 0 foo   1.5\r\n" << "1 bar -2e3\n";
+    }
+    csv_view v(file.path);
+
+    ASSERT_EQ(3u, v.num_rows());
+    EXPECT_EQ(3u, v[0].size());
+    EXPECT_EQ(2, v.column("value"));
+    EXPECT_EQ(-1, v.column("missing"));
+    EXPECT_EQ("foo", v[1][1].str());
+    EXPECT_EQ(1, v[2][0].as_int());
+    EXPECT_EQ(1.5, v[1][2].as_double());
+    EXPECT_EQ(-2000, v[2][2].as_double());
+
+    // Fields point into the view, which can only be shared
+    static_assert(!std::is_copy_constructible<csv_view>::value && !std::is_move_constructible<csv_view>::value,
+                  "csv_view must stay in place");
+
+    csv_view m({{"a", "b"}, {"1", ""}});
+    ASSERT_EQ(2u, m.num_rows());
+    EXPECT_EQ("", m[1][1].str());
+    EXPECT_EQ(1, m[1][0].as_int());
+}
+
+TEST(csv_field, numbers) {
+    auto field = [](const std::string& s) { return csv_field{s.data(), s.size()}; };
+    for (auto s: {"0.1", "-0.3", "12345.678", "1e-5", "6.02214076e23", "0.12345678901234567", "1e-300", "  7.25 "}) {
+        EXPECT_EQ(std::strtod(s, nullptr), field(s).as_double()) << s;
+    }
+    EXPECT_EQ(-42, field("-42").as_int());
+    EXPECT_EQ(9223372036854775807LL, field("9223372036854775807").as_int());
+
+    for (auto s: {"", "abc", "1.5x", "--1", "1e", "."}) {
+        EXPECT_THROW(field(s).as_double(), sonata_exception) << s;
+    }
+    EXPECT_THROW(field("1.5").as_int(), sonata_exception);
+    EXPECT_THROW(field("9223372036854775808").as_int(), sonata_exception);
+}
+
+TEST(csv_record, columns) {
+    csv_file a("a.csv", {{"edge_type_id", "pop_name", "delay", "model_template"},
+                         {"1", "pop_a", "0.5", "expsyn"},
+                         {"2", "pop_a", "", "exp2syn"}});
+    csv_file b("b.csv", {{"edge_type_id", "pop_name", "syn_weight"},
+                         {"1", "pop_b", "-2e-3"},
+                         {"1", "pop_a", "3"}});
+    csv_record r({a, b});
+
+    type_pop_id a1(1, "pop_a"), a2(2, "pop_a"), b1(1, "pop_b");
+    EXPECT_EQ(3u, r.unique_ids().size());
+
+    auto delay = r.column_id("delay");
+    auto weight = r.column_id("syn_weight");
+    auto mech = r.column_id("model_template");
+    EXPECT_EQ(-1, r.column_id("edge_type_id"));
+    EXPECT_EQ(-1, r.column_id("missing"));
+
+    // pop_a type 1 is replaced by the second file
+    EXPECT_FALSE(r.has_field(a1, delay));
+    EXPECT_EQ(3, r.double_field(a1, weight));
+    EXPECT_FALSE(r.has_field(a2, delay));
+    EXPECT_EQ("exp2syn", r.string_field(a2, mech));
+    EXPECT_EQ(-2e-3, r.double_field(b1, weight));
+    EXPECT_FALSE(r.has_field(b1, -1));
+
+    EXPECT_THROW(r.double_field(a2, delay), sonata_exception);
+    EXPECT_THROW(r.double_field(a2, mech), sonata_exception);
+    EXPECT_THROW(r.has_field(type_pop_id(3, "pop_a"), delay), sonata_exception);
+
+    auto fields = r.fields(a2);
+    EXPECT_EQ(2u, fields.size());
+    EXPECT_EQ("pop_a", fields.at("pop_name"));
+}
+
+TEST(csv_record, empty_fields) {
+    // An empty field is missing, like a column the file lacks
+    csv_file f("types.csv", {{"edge_type_id", "pop_name", "delay", "syn_weight", "model_template"},
+                             {"1", "pop_a", "", "2"}});
+    csv_record r({f});
+
+    type_pop_id a1(1, "pop_a");
+    auto delay = r.column_id("delay");
+    auto mech = r.column_id("model_template");
+    EXPECT_FALSE(r.has_field(a1, delay));
+    EXPECT_FALSE(r.has_field(a1, mech));
+    EXPECT_THROW(r.string_field(a1, delay), sonata_exception);
+    EXPECT_EQ(2, r.double_field(a1, r.column_id("syn_weight")));
+
+    auto fields = r.fields(a1);
+    EXPECT_EQ(0u, fields.count("delay"));
+    EXPECT_EQ(0u, fields.count("model_template"));
+    EXPECT_EQ(2u, fields.size());
+}
+
+TEST(type_pop_id, interned_population) {
+    type_pop_id a(100, "pop_e");
+    type_pop_id b(100, std::string("pop_e"));
+    type_pop_id c(101, "pop_e");
+    type_pop_id d(100, "pop_i");
+
+    EXPECT_EQ(a.pop_id, b.pop_id);
+    EXPECT_EQ(a.pop_id, c.pop_id);
+    EXPECT_NE(a.pop_id, d.pop_id);
+    EXPECT_EQ("pop_e", a.pop_name());
+    EXPECT_EQ("pop_i", d.pop_name());
+
+    EXPECT_TRUE(a == b);
+    EXPECT_FALSE(a == c);
+    EXPECT_FALSE(a == d);
+    EXPECT_TRUE(a == type_pop_id(100, a.pop_id));
+}
+
 TEST(csv_node_record, constructor) {
     std::string datadir{DATADIR};
     auto filename = datadir + "/nodes.csv";
@@ -143,6 +296,37 @@ TEST(csv_node_record, constructor) {
 
 }
 
+TEST(csv_node_record, density_mech_desc_override) {
+    std::string datadir{DATADIR};
+    auto filename = datadir + "/nodes.csv";
+    auto f = csv_file(filename);
+    auto r = csv_node_record({f});
+
+    type_pop_id t0({100, "pop_e"});
+
+    std::unordered_map<std::string, variable_map> overrides;
+    overrides["pas_0"]["e_pas"] = -80;
+    overrides["pas_0"]["not_a_variable"] = 1;
+
+    auto l0 = r.density_mech_desc(t0, overrides);
+    for (auto m: l0.at("dend")) {
+        if (m.name() == "pas") {
+            EXPECT_EQ(-80, m.get("e"));
+            EXPECT_EQ(0.001, m.get("g"));
+        }
+    }
+
+    // The record is left untouched
+    EXPECT_EQ(-70, r.dynamic_params(t0)["pas_0"]["e_pas"]);
+    EXPECT_EQ(0, r.dynamic_params(t0)["pas_0"].count("not_a_variable"));
+
+    for (auto m: r.density_mech_desc(t0).at("dend")) {
+        if (m.name() == "pas") {
+            EXPECT_EQ(-70, m.get("e"));
+        }
+    }
+}
+
 TEST(csv_edge_record, constructor) {
     std::string datadir{DATADIR};
     auto filename = datadir + "/edges.csv";
@@ -0,0 +1,891 @@
+#include <arbor/cable_cell.hpp>
+#include <arbor/domain_decomposition.hpp>
+#include <arbor/version.hpp>
+
+#include <cstdint>
+#include <functional>
+#include <map>
+#include <memory>
+#include <set>
+#include <vector>
+
+#include "data_management_lib.hpp"
+#include "procedural_circuit.hpp"
+#include "sonata_exceptions.hpp"
+
+#ifdef ARB_MPI_ENABLED
+#include <mpi.h>
+#endif
+
+#include "../gtest.h"
+
+namespace {
+// Virtual source cells projecting onto virtual target cells, with input spikes on the sources
+procedural_params small_network(unsigned num_sources, unsigned num_targets, unsigned in_degree) {
+    procedural_params p;
+    p.populations = {{"src", num_sources}, {"tgt", num_targets}};
+    p.projections = {{"src_tgt", "src", "tgt", in_degree}};
+    p.spikes = {{"src", 5, 10, 3}};
+    p.seed = 7;
+    return p;
+}
+
+// Groups of `group_size` consecutive cells of `gids`
+std::vector<arb::group_description> make_groups(const database& db, const std::vector<cell_gid_type>& gids,
+                                                unsigned group_size) {
+    std::vector<arb::group_description> groups;
+    for (unsigned i = 0; i < gids.size(); i += group_size) {
+        std::vector<cell_gid_type> g(gids.begin() + i, gids.begin() + std::min<std::size_t>(gids.size(), i + group_size));
+        groups.push_back({db.get_cell_kind(g.front()), g, arb::backend_kind::multicore});
+    }
+    return groups;
+}
+
+std::vector<cell_gid_type> all_cells(const database& db) {
+    std::vector<cell_gid_type> gids;
+    for (cell_gid_type gid = 0; gid < db.num_cells(); gid++) {
+        gids.push_back(gid);
+    }
+    return gids;
+}
+
+// Database of `circuit` with the cells `gids` local, in groups of `group_size` cells
+std::unique_ptr<database> make_database(const circuit_source& circuit, database_options opts,
+                                        std::vector<cell_gid_type> gids = {}, unsigned group_size = 4) {
+    std::unique_ptr<database> db(new database(circuit, opts));
+    if (gids.empty()) {
+        gids = all_cells(*db);
+    }
+    db->build_local_maps(make_groups(*db, gids, group_size));
+    return db;
+}
+
+// Dataset forwarding to `inner`, counting the elements read
+class counted_dataset: public storage_dataset {
+public:
+    counted_dataset(std::shared_ptr<storage_dataset> inner): inner_(std::move(inner)) {}
+
+    std::string name() override { return inner_->name(); }
+    int size() override { return inner_->size(); }
+    int int_at(const int i) override { return count(1), inner_->int_at(i); }
+    double double_at(const int i) override { return count(1), inner_->double_at(i); }
+    int string_at(const int i) override { return count(1), inner_->string_at(i); }
+    std::vector<int> int_range(const int i, const int j) override { return count(j - i), inner_->int_range(i, j); }
+    std::vector<double> double_range(const int i, const int j) override { return count(j - i), inner_->double_range(i, j); }
+    std::pair<int, int> int_pair_at(const int i) override { return count(1), inner_->int_pair_at(i); }
+    std::vector<std::pair<int, int>> int_pair_range(const int i, const int j) override {
+        return count(j - i), inner_->int_pair_range(i, j);
+    }
+    std::vector<int> int_1d() override { return count(size()), inner_->int_1d(); }
+    std::vector<std::pair<int, int>> int_2d() override { return count(size()), inner_->int_2d(); }
+
+    unsigned long elements_read = 0;
+
+private:
+    void count(unsigned long n) { elements_read += n; }
+
+    std::shared_ptr<storage_dataset> inner_;
+};
+
+// Copy of group `g`, with the datasets and sub-groups of `datasets` and `groups` replacing those of the
+// same name, or added
+std::shared_ptr<h5_group> replace_members(const std::shared_ptr<h5_group>& g,
+                                          std::vector<std::shared_ptr<storage_dataset>> datasets,
+                                          std::vector<std::shared_ptr<h5_group>> groups = {}) {
+    for (auto& d: g->datasets_) {
+        if (std::none_of(datasets.begin(), datasets.end(), [&](const std::shared_ptr<storage_dataset>& n) { return n->name() == d->name(); })) {
+            datasets.push_back(d);
+        }
+    }
+    for (auto& c: g->groups_) {
+        if (std::none_of(groups.begin(), groups.end(), [&](const std::shared_ptr<h5_group>& n) { return n->name() == c->name(); })) {
+            groups.push_back(c);
+        }
+    }
+    return std::make_shared<h5_group>(g->name(), std::move(groups), std::move(datasets));
+}
+
+// Circuit of `base`, with every edge population rewritten by `rewrite`, and every node population
+// by `rewrite_nodes` if given
+class rewritten_circuit: public circuit_source {
+public:
+    using rewrite_fn = std::function<std::shared_ptr<h5_group>(const std::shared_ptr<h5_group>&)>;
+
+    rewritten_circuit(const circuit_source& base, rewrite_fn rewrite, rewrite_fn rewrite_nodes = nullptr):
+        base_(base), rewrite_(std::move(rewrite)), rewrite_nodes_(std::move(rewrite_nodes)) {}
+
+    h5_record nodes() const override {
+        if (!rewrite_nodes_) {
+            return base_.nodes();
+        }
+        std::vector<std::shared_ptr<h5_group>> pops;
+        for (auto& p: base_.nodes().populations()) {
+            pops.push_back(rewrite_nodes_(p.group()));
+        }
+        return h5_record(pops);
+    }
+    h5_record edges() const override {
+        std::vector<std::shared_ptr<h5_group>> pops;
+        for (auto& p: base_.edges().populations()) {
+            pops.push_back(rewrite_(p.group()));
+        }
+        return h5_record(pops);
+    }
+    csv_node_record node_types() const override { return base_.node_types(); }
+    csv_edge_record edge_types() const override { return base_.edge_types(); }
+    std::vector<spike_info> spikes() const override { return base_.spikes(); }
+    std::vector<current_clamp_info> current_clamps() const override { return base_.current_clamps(); }
+    std::uint64_t content_hash() const override { return hash_string("rewritten", base_.content_hash()); }
+
+private:
+    const circuit_source& base_;
+    rewrite_fn rewrite_;
+    rewrite_fn rewrite_nodes_;
+};
+
+// Circuit of `base`, with the electrodes of `clamps`
+class clamped_circuit: public circuit_source {
+public:
+    clamped_circuit(const circuit_source& base, std::vector<current_clamp_info> clamps):
+        base_(base), clamps_(std::move(clamps)) {}
+
+    h5_record nodes() const override { return base_.nodes(); }
+    h5_record edges() const override { return base_.edges(); }
+    csv_node_record node_types() const override { return base_.node_types(); }
+    csv_edge_record edge_types() const override { return base_.edge_types(); }
+    std::vector<spike_info> spikes() const override { return base_.spikes(); }
+    std::vector<current_clamp_info> current_clamps() const override { return clamps_; }
+    std::uint64_t content_hash() const override { return base_.content_hash(); }
+
+private:
+    const circuit_source& base_;
+    std::vector<current_clamp_info> clamps_;
+};
+
+// Expects `a` and `b` to give the same connectivity for the cells [0, num_cells), with locations
+// equal within `tolerance`; queries the cells in `order` if given
+void expect_same_network(database& a, database& b, cell_gid_type num_cells, double tolerance,
+                         std::vector<cell_gid_type> order = {}) {
+    if (order.empty()) {
+        for (cell_gid_type gid = 0; gid < num_cells; gid++) {
+            order.push_back(gid);
+        }
+    }
+    for (auto gid: order) {
+        EXPECT_EQ(a.num_sources(gid), b.num_sources(gid)) << gid;
+        EXPECT_EQ(a.num_targets(gid), b.num_targets(gid)) << gid;
+
+        std::vector<arb::cell_connection> ca, cb;
+        a.get_connections(gid, ca);
+        b.get_connections(gid, cb);
+        ASSERT_EQ(ca.size(), cb.size()) << gid;
+        for (unsigned i = 0; i < ca.size(); i++) {
+            EXPECT_EQ(ca[i].source.gid, cb[i].source.gid);
+            EXPECT_EQ(ca[i].source.index, cb[i].source.index);
+            EXPECT_EQ(ca[i].dest.gid, cb[i].dest.gid);
+            EXPECT_EQ(ca[i].dest.index, cb[i].dest.index);
+            EXPECT_EQ(ca[i].weight, cb[i].weight);
+            EXPECT_EQ(ca[i].delay, cb[i].delay);
+        }
+
+        std::vector<segment_location> sa, sb;
+        std::vector<std::pair<segment_location, arb::mechanism_desc>> ta, tb;
+        a.get_sources_and_targets(gid, sa, ta);
+        b.get_sources_and_targets(gid, sb, tb);
+        ASSERT_EQ(sa.size(), sb.size()) << gid;
+        for (unsigned i = 0; i < sa.size(); i++) {
+            EXPECT_EQ(sa[i].segment, sb[i].segment);
+            EXPECT_NEAR(sa[i].position, sb[i].position, tolerance);
+        }
+        ASSERT_EQ(ta.size(), tb.size()) << gid;
+        for (unsigned i = 0; i < ta.size(); i++) {
+            EXPECT_EQ(ta[i].first.segment, tb[i].first.segment);
+            EXPECT_NEAR(ta[i].first.position, tb[i].first.position, tolerance);
+            EXPECT_EQ(ta[i].second.name(), tb[i].second.name());
+            EXPECT_EQ(ta[i].second.values(), tb[i].second.values());
+        }
+    }
+}
+}
+
+TEST(database, local_spikes) {
+    procedural_circuit circuit(small_network(10, 6, 2));
+    auto all = make_database(circuit, {});
+
+    // Every source cell spikes 3 times, 10 ms apart, from a phase in [5, 15)
+    for (cell_gid_type gid = 0; gid < 10; gid++) {
+        auto spikes = all->get_spikes(gid);
+        ASSERT_EQ(3u, spikes.size());
+        EXPECT_LE(5, spikes[0]);
+        EXPECT_GT(15, spikes[0]);
+        EXPECT_DOUBLE_EQ(spikes[0] + 10, spikes[1]);
+        EXPECT_DOUBLE_EQ(spikes[0] + 20, spikes[2]);
+    }
+    for (cell_gid_type gid = 10; gid < 16; gid++) {
+        EXPECT_TRUE(all->get_spikes(gid).empty());
+    }
+
+    // Loading the spikes of a subset of the cells gives the same trains
+    std::vector<cell_gid_type> odd = {1, 3, 5, 7, 9, 11};
+    auto part = make_database(circuit, {}, odd);
+    for (auto gid: odd) {
+        EXPECT_EQ(all->get_spikes(gid), part->get_spikes(gid));
+    }
+    EXPECT_THROW(part->get_spikes(2), sonata_exception);
+}
+
+TEST(database, local_current_clamps) {
+    procedural_circuit base(small_network(10, 6, 2));
+
+    // Node 2 of "tgt" is gid 12 and node 3 of "src" is gid 3; the other electrodes are on gids 14 and 5
+    csv_file params("stim_params", {{"electrode_id", "node_id", "population", "sec_id", "seg_x"},
+                                    {"0", "2", "tgt", "1", "0.25"},
+                                    {"1", "4", "tgt", "0", "0.5"},
+                                    {"2", "3", "src", "0", "0.75"},
+                                    {"3", "5", "src", "0", "0.5"}});
+    csv_file locs("stim_loc", {{"electrode_id", "dur", "amp", "delay"},
+                               {"0", "100", "0.5", "10"},
+                               {"1", "200", "0.25", "20"},
+                               {"2", "300", "0.125", "30"},
+                               {"3", "400", "1", "40"}});
+    clamped_circuit circuit(base, {{params, locs}});
+
+    std::vector<cell_gid_type> local = {3, 12, 13};
+    auto db = make_database(circuit, {}, local, 2);
+
+    auto tgt = db->get_current_clamps(12);
+    ASSERT_EQ(1u, tgt.size());
+    EXPECT_EQ(100, tgt[0].duration);
+    EXPECT_EQ(0.5, tgt[0].amplitude);
+    EXPECT_EQ(10, tgt[0].delay);
+    EXPECT_EQ(1u, tgt[0].stim_loc.segment);
+    EXPECT_EQ(0.25, tgt[0].stim_loc.position);
+
+    auto src = db->get_current_clamps(3);
+    ASSERT_EQ(1u, src.size());
+    EXPECT_EQ(300, src[0].duration);
+    EXPECT_EQ(0.125, src[0].amplitude);
+    EXPECT_EQ(30, src[0].delay);
+    EXPECT_EQ(0u, src[0].stim_loc.segment);
+    EXPECT_EQ(0.75, src[0].stim_loc.position);
+
+    // The electrodes of the other cells are not kept
+    for (cell_gid_type gid = 0; gid < 16; gid++) {
+        if (gid != 3 && gid != 12) {
+            EXPECT_TRUE(db->get_current_clamps(gid).empty()) << gid;
+        }
+    }
+}
+
+TEST(database, target_table) {
+    unsigned ns = 10, nt = 6, k = 3;
+    procedural_circuit circuit(small_network(ns, nt, k));
+
+    // Rows of the table in an order unrelated to the gids
+    std::vector<cell_gid_type> gids = {15, 2, 11, 12, 0, 13, 1, 3, 4, 5, 6, 7, 8, 9, 10, 14};
+    auto db = make_database(circuit, {}, gids, 3);
+
+    for (cell_gid_type gid = 0; gid < ns; gid++) {
+        EXPECT_EQ(0u, db->num_targets(gid));
+    }
+    for (unsigned t = 0; t < nt; t++) {
+        cell_gid_type gid = ns + t;
+        ASSERT_EQ(k, db->num_targets(gid));
+
+        std::vector<segment_location> src;
+        std::vector<std::pair<segment_location, arb::mechanism_desc>> tgt;
+        db->get_sources_and_targets(gid, src, tgt);
+        EXPECT_EQ(k, tgt.size());
+
+        // Targets are in edge order, so target j receives the edge of slot j
+        std::vector<arb::cell_connection> conns;
+        db->get_connections(gid, conns);
+        ASSERT_EQ(k, conns.size());
+        std::vector<unsigned> seen(k, 0);
+        for (auto& c: conns) {
+            ASSERT_LT(c.dest.index, k);
+            EXPECT_EQ(gid, c.dest.gid);
+            EXPECT_EQ(circuit.source_of(0, t, c.dest.index), c.source.gid);
+            EXPECT_EQ(0u, c.source.index);
+            seen[c.dest.index]++;
+        }
+        EXPECT_EQ(std::vector<unsigned>(k, 1), seen);
+    }
+
+    for (cell_gid_type gid = 0; gid < ns; gid++) {
+        EXPECT_EQ(1u, db->num_sources(gid));
+    }
+}
+
+TEST(synapse_table, intern) {
+    synapse_table table;
+    auto a = arb::mechanism_desc("expsyn").set("tau", 2).set("e", 0);
+    auto b = arb::mechanism_desc("expsyn").set("e", 0).set("tau", 2);
+    auto c = arb::mechanism_desc("expsyn").set("e", 0).set("tau", 3);
+    auto d = arb::mechanism_desc("exp2syn").set("e", 0).set("tau", 2);
+
+    // Equal descriptions share an id whatever the order of their parameters
+    auto ia = table.intern(a);
+    EXPECT_EQ(ia, table.intern(b));
+    EXPECT_NE(ia, table.intern(c));
+    EXPECT_NE(ia, table.intern(d));
+    EXPECT_NE(ia, table.intern(arb::mechanism_desc("expsyn")));
+    EXPECT_EQ(4u, table.size());
+    EXPECT_EQ(3, table[table.intern(c)].get("tau"));
+}
+
+TEST(database, released_build_state) {
+    // Cable target cells, described by the example components
+    std::string components = std::string(DATADIR) + "/../../../example/components";
+    auto p = small_network(4, 3, 1);
+    p.populations[1].model_type = "biophysical";
+    p.populations[1].morphology = components + "/morphologies/soma_branch.swc";
+    p.populations[1].model_template = components + "/density_params/set_pas.json";
+    procedural_circuit circuit(p);
+
+    auto db = make_database(circuit, {});
+    auto spikes = db->get_spikes(0);
+    EXPECT_EQ(3u, spikes.size());
+
+    db->release_build_state();
+
+    // Cell kinds and the population layout stay available to arbor and the outputs
+    for (cell_gid_type gid = 0; gid < 4; gid++) {
+        EXPECT_EQ(arb::cell_kind::spike_source, db->get_cell_kind(gid));
+    }
+    for (cell_gid_type gid = 4; gid < 7; gid++) {
+        EXPECT_EQ(arb::cell_kind::cable, db->get_cell_kind(gid));
+    }
+    EXPECT_EQ(7u, db->num_cells());
+    EXPECT_EQ("tgt", db->population_of(5));
+
+    // The inputs and the connectivity are gone
+    std::vector<arb::cell_connection> conns;
+    EXPECT_THROW(db->get_spikes(0), sonata_exception);
+    EXPECT_THROW(db->get_connections(5, conns), sonata_exception);
+}
+
+#ifdef ARB_MPI_ENABLED
+TEST(database, shared_tables) {
+    int rank, size;
+    MPI_Comm_rank(MPI_COMM_WORLD, &rank);
+    MPI_Comm_size(MPI_COMM_WORLD, &size);
+
+    // Cable target cells with sources along a section, so that cells have several sources
+    std::string components = std::string(DATADIR) + "/../../../example/components";
+    auto p = small_network(40, 24, 3);
+    p.populations[1].model_type = "biophysical";
+    p.populations[1].morphology = components + "/morphologies/soma_branch.swc";
+    p.populations[1].model_template = components + "/density_params/set_pas.json";
+    p.projections.push_back({"tgt_tgt", "tgt", "tgt", 2});
+    p.projections.back().efferent_section = 1;
+    p.projections.back().edge_attributes = {{"efferent_section_pos", [](unsigned e) { return (e % 5)/5.; }}};
+    procedural_circuit circuit(p);
+
+    // Cells dealt round-robin over the ranks, so that every rank contributes to the tables
+    std::vector<cell_gid_type> local;
+    for (cell_gid_type gid = rank; gid < 64; gid += size) {
+        local.push_back(gid);
+    }
+    ASSERT_FALSE(local.empty());
+
+    database_options shared;
+    shared.shared_tables = true;
+    auto ref = make_database(circuit, {}, local, 3);
+    auto db = make_database(circuit, shared, local, 3);
+
+    // Global tables
+    for (cell_gid_type gid = 0; gid < 64; gid++) {
+        EXPECT_EQ(ref->get_cell_kind(gid), db->get_cell_kind(gid)) << gid;
+        EXPECT_EQ(ref->num_sources(gid), db->num_sources(gid)) << gid;
+    }
+
+    // Source locations of the local cells, and the source indices of their connections
+    for (auto gid: local) {
+        std::vector<arb::segment_location> src_ref, src;
+        std::vector<std::pair<arb::segment_location, arb::mechanism_desc>> tgt_ref, tgt;
+        ref->get_sources_and_targets(gid, src_ref, tgt_ref);
+        db->get_sources_and_targets(gid, src, tgt);
+        ASSERT_EQ(src_ref.size(), src.size()) << gid;
+        for (unsigned i = 0; i < src.size(); i++) {
+            EXPECT_EQ(src_ref[i].segment, src[i].segment);
+            EXPECT_EQ(src_ref[i].position, src[i].position);
+        }
+    }
+    expect_same_network(*ref, *db, 64, 0, local);
+}
+#endif
+
+TEST(database, overlap_source_exchange) {
+    int rank = 0, size = 1;
+#ifdef ARB_MPI_ENABLED
+    MPI_Comm_rank(MPI_COMM_WORLD, &rank);
+    MPI_Comm_size(MPI_COMM_WORLD, &size);
+#endif
+    auto p = small_network(20, 12, 3);
+    p.projections[0].edge_attributes = {{"efferent_section_pos", [](unsigned e) { return (e % 7)/7.; }},
+                                        {"afferent_section_pos", [](unsigned e) { return (e % 3)/3.; }}};
+    procedural_circuit circuit(p);
+
+    std::vector<cell_gid_type> local;
+    for (cell_gid_type gid = rank; gid < 32; gid += size) {
+        local.push_back(gid);
+    }
+
+    // The targets read while the source table is exchanged are those read after the exchange
+    for (bool compact: {false, true}) {
+        database_options opts;
+        opts.compact_edges = compact;
+        auto overlapped = make_database(circuit, opts, local, 3);
+        opts.overlap_source_exchange = false;
+        auto sequential = make_database(circuit, opts, local, 3);
+
+        expect_same_network(*overlapped, *sequential, 32, 0, local);
+        EXPECT_EQ(sequential->edge_precision().compact_targets, overlapped->edge_precision().compact_targets);
+        EXPECT_EQ(sequential->edge_precision().max_position_error, overlapped->edge_precision().max_position_error);
+        for (cell_gid_type gid = 0; gid < 32; gid++) {
+            EXPECT_EQ(sequential->num_sources(gid), overlapped->num_sources(gid)) << gid;
+        }
+    }
+}
+
+TEST(database, compact_edges) {
+    // Two projections onto the targets, at locations that are not multiples of the quantum
+    auto p = small_network(10, 6, 3);
+    p.projections.push_back({"src_tgt_b", "src", "tgt", 2});
+    p.projections[1].afferent_section = 2;
+    p.projections[1].afferent_position = 0.123456789;
+    p.projections[1].efferent_section = 1;
+    p.projections[1].efferent_position = 0.987654321;
+    p.projections[1].weight = 0.5;
+    procedural_circuit circuit(p);
+
+    database_options compact;
+    compact.compact_edges = true;
+    auto exact = make_database(circuit, {});
+    auto approx = make_database(circuit, compact);
+    EXPECT_FALSE(exact->edge_precision().compact_sources);
+    EXPECT_TRUE(approx->edge_precision().compact_sources);
+    EXPECT_TRUE(approx->edge_precision().compact_targets);
+
+    double quantum = 1.0/65535;
+    EXPECT_LT(0, approx->edge_precision().max_position_error);
+    EXPECT_GE(quantum/2, approx->edge_precision().max_position_error);
+    expect_same_network(*exact, *approx, 16, quantum/2);
+}
+
+TEST(database, streamed_targets) {
+    auto p = small_network(10, 6, 3);
+    p.projections.push_back({"src_tgt_b", "src", "tgt", 2});
+    p.projections[1].afferent_section = 1;
+    p.projections[1].afferent_position = 0.25;
+    procedural_circuit circuit(p);
+
+    // Queries that jump between the 6 groups of 3 cells, and come back to evicted groups
+    std::vector<cell_gid_type> order;
+    for (unsigned i = 0; i < 3; i++) {
+        for (cell_gid_type gid = i; gid < 16; gid += 3) {
+            order.push_back(gid);
+        }
+    }
+    order.insert(order.end(), order.rbegin(), order.rend());
+
+    auto all = make_database(circuit, {}, {}, 3);
+    for (unsigned resident: {1u, 2u, 6u}) {
+        database_options opts;
+        opts.resident_groups = resident;
+        auto streamed = make_database(circuit, opts, {}, 3);
+        expect_same_network(*all, *streamed, 16, 0, order);
+    }
+
+    // With compact edges, only the sources of a streamed database are compacted
+    database_options opts;
+    opts.resident_groups = 2;
+    opts.compact_edges = true;
+    auto compact = make_database(circuit, opts, {}, 3);
+    EXPECT_TRUE(compact->edge_precision().compact_sources);
+    EXPECT_FALSE(compact->edge_precision().compact_targets);
+    expect_same_network(*all, *compact, 16, 0.5/65535, order);
+
+    // The target positions are exact
+    for (cell_gid_type gid = 10; gid < 16; gid++) {
+        std::vector<arb::segment_location> src_all, src;
+        std::vector<std::pair<arb::segment_location, arb::mechanism_desc>> tgt_all, tgt;
+        all->get_sources_and_targets(gid, src_all, tgt_all);
+        compact->get_sources_and_targets(gid, src, tgt);
+        ASSERT_EQ(tgt_all.size(), tgt.size());
+        for (unsigned i = 0; i < tgt.size(); i++) {
+            EXPECT_EQ(tgt_all[i].first.position, tgt[i].first.position);
+        }
+    }
+}
+
+TEST(database, content_hash_only_with_cache) {
+    // Counts the calls to content_hash
+    struct counting_circuit: procedural_circuit {
+        using procedural_circuit::procedural_circuit;
+        std::uint64_t content_hash() const override {
+            calls++;
+            return procedural_circuit::content_hash();
+        }
+        mutable unsigned calls = 0;
+    };
+    counting_circuit circuit(small_network(4, 3, 1));
+
+    database uncached(circuit);
+    EXPECT_EQ(0u, circuit.calls);
+
+    // The image is only written once the local maps are built
+    database_options opts;
+    opts.circuit_cache = ".";
+    database cached(circuit, opts);
+    EXPECT_EQ(1u, circuit.calls);
+}
+
+TEST(database, nsyns) {
+    unsigned ns = 10, nt = 6, k = 3;
+    auto p = small_network(ns, nt, k);
+
+    // Edge e has e % 4 synapses, so some edges have none
+    auto nsyns = [](unsigned e) { return e % 4; };
+    p.projections[0].edge_attributes = {{"nsyns", [nsyns](unsigned e) { return double(nsyns(e)); }}};
+    procedural_circuit circuit(p);
+
+    database_options streamed;
+    streamed.resident_groups = 1;
+    for (auto opts: {database_options(), streamed}) {
+        auto db = make_database(circuit, opts, {}, 3);
+
+        for (unsigned t = 0; t < nt; t++) {
+            cell_gid_type gid = ns + t;
+
+            // An edge with n synapses has n targets and n connections from its source
+            unsigned num_synapses = 0;
+            std::map<cell_gid_type, unsigned> from;
+            for (unsigned j = 0; j < k; j++) {
+                num_synapses += nsyns(j*nt + t);
+                from[circuit.source_of(0, t, j)] += nsyns(j*nt + t);
+            }
+            EXPECT_EQ(num_synapses, db->num_targets(gid));
+
+            std::vector<segment_location> src;
+            std::vector<std::pair<segment_location, arb::mechanism_desc>> tgt;
+            db->get_sources_and_targets(gid, src, tgt);
+            EXPECT_EQ(num_synapses, tgt.size());
+
+            // Every connection has a target of its own
+            std::vector<arb::cell_connection> conns;
+            db->get_connections(gid, conns);
+            ASSERT_EQ(num_synapses, conns.size());
+            std::vector<unsigned> seen(num_synapses, 0);
+            std::map<cell_gid_type, unsigned> conns_from;
+            for (auto& c: conns) {
+                ASSERT_LT(c.dest.index, num_synapses);
+                seen[c.dest.index]++;
+                conns_from[c.source.gid]++;
+            }
+            EXPECT_EQ(std::vector<unsigned>(num_synapses, 1), seen);
+            for (auto& f: from) {
+                EXPECT_EQ(f.second, conns_from[f.first]) << f.first;
+            }
+        }
+    }
+}
+
+namespace {
+// Projections onto the 4 targets, all at section 1 unless stated:
+//   "a"  4 expsyn edges per target at 0.5
+//   "b"  2 expsyn edges per target at 0.5, with tau 3 instead of the default of the catalogue
+//   "c"  2 exp2syn edges per target at 0.5
+//   "d"  2 expsyn edges per target, at 0.1 for the first and 0.2 for the second
+procedural_params synapse_mix() {
+    auto p = small_network(10, 4, 4);
+    p.projections[0].name = "a";
+    p.projections.push_back({"b", "src", "tgt", 2});
+    p.projections.push_back({"c", "src", "tgt", 2});
+    p.projections.push_back({"d", "src", "tgt", 2});
+    for (auto& proj: p.projections) {
+        proj.afferent_section = 1;
+    }
+    p.projections[1].edge_attributes = {{"tau", [](unsigned) { return 3.; }}};
+    p.projections[2].model_template = "exp2syn";
+    p.projections[3].edge_attributes = {{"afferent_section_pos", [](unsigned e) { return 0.1*(1 + e/4); }}};
+    return p;
+}
+
+// Expects the connections of every target cell to have the same sources, locations and synapses
+// in `db` as in `ref`, a database of the same circuit without instances, with positions equal within `tolerance`
+void expect_same_synapses(database& ref, database& db, cell_gid_type first, cell_gid_type last, double tolerance = 0) {
+    for (auto gid = first; gid < last; gid++) {
+        std::vector<segment_location> src;
+        std::vector<std::pair<segment_location, arb::mechanism_desc>> ref_tgt, tgt;
+        ref.get_sources_and_targets(gid, src, ref_tgt);
+        db.get_sources_and_targets(gid, src, tgt);
+        EXPECT_EQ(db.num_targets(gid), tgt.size());
+
+        std::vector<arb::cell_connection> ref_conns, conns;
+        ref.get_connections(gid, ref_conns);
+        db.get_connections(gid, conns);
+        EXPECT_EQ(ref_tgt.size(), conns.size());
+        ASSERT_EQ(ref_conns.size(), conns.size());
+        for (unsigned i = 0; i < conns.size(); i++) {
+            EXPECT_EQ(ref_conns[i].source.gid, conns[i].source.gid);
+            EXPECT_EQ(ref_conns[i].weight, conns[i].weight);
+            ASSERT_LT(conns[i].dest.index, tgt.size());
+            auto& expected = ref_tgt[ref_conns[i].dest.index];
+            auto& actual = tgt[conns[i].dest.index];
+            EXPECT_EQ(expected.first.segment, actual.first.segment);
+            EXPECT_NEAR(expected.first.position, actual.first.position, tolerance);
+            EXPECT_EQ(expected.second.name(), actual.second.name());
+            EXPECT_EQ(expected.second.values(), actual.second.values());
+        }
+    }
+}
+
+std::vector<unsigned> target_counts(database& db, cell_gid_type first, cell_gid_type last) {
+    std::vector<unsigned> counts;
+    for (auto gid = first; gid < last; gid++) {
+        counts.push_back(db.num_targets(gid));
+    }
+    return counts;
+}
+}
+
+TEST(database, coalesce_synapses) {
+    procedural_circuit circuit(synapse_mix());
+    auto ref = make_database(circuit, {});
+    EXPECT_EQ(std::vector<unsigned>(4, 10), target_counts(*ref, 10, 14));
+
+    // Only "a" and "b" are merged, each into one synapse, if exp2syn is not linear
+    database_options opts;
+    opts.coalesce_synapses = true;
+    opts.linear_synapses = {"expsyn"};
+    auto db = make_database(circuit, opts);
+    expect_same_synapses(*ref, *db, 10, 14);
+    EXPECT_EQ(std::vector<unsigned>(4, 6), target_counts(*db, 10, 14));
+
+    // With exp2syn linear "c" is merged too
+    opts.linear_synapses = {"expsyn", "exp2syn"};
+    db = make_database(circuit, opts);
+    expect_same_synapses(*ref, *db, 10, 14);
+    EXPECT_EQ(std::vector<unsigned>(4, 5), target_counts(*db, 10, 14));
+
+    // The connections of a merged projection share their target, found from their synapse in `ref`
+    std::vector<segment_location> src;
+    std::vector<std::pair<segment_location, arb::mechanism_desc>> ref_tgt;
+    std::vector<arb::cell_connection> ref_conns, conns;
+    ref->get_sources_and_targets(12, src, ref_tgt);
+    ref->get_connections(12, ref_conns);
+    db->get_connections(12, conns);
+    std::map<std::string, std::set<unsigned>> targets_of;
+    for (unsigned i = 0; i < conns.size(); i++) {
+        auto& t = ref_tgt[ref_conns[i].dest.index];
+        if (t.first.position == 0.5) {
+            auto synapse = t.second.name() + (t.second.values().count("tau") ? " with tau" : "");
+            targets_of[synapse].insert(conns[i].dest.index);
+        }
+    }
+    ASSERT_EQ(3u, targets_of.size());
+    for (auto& t: targets_of) {
+        EXPECT_EQ(1u, t.second.size()) << t.first;
+    }
+
+    // Same in streaming mode
+    opts.resident_groups = 1;
+    db = make_database(circuit, opts);
+    expect_same_synapses(*ref, *db, 10, 14);
+    EXPECT_EQ(std::vector<unsigned>(4, 5), target_counts(*db, 10, 14));
+}
+
+TEST(database, order_targets) {
+    // Projections in an order unrelated to their sections
+    auto p = synapse_mix();
+    p.projections[0].afferent_section = 2;
+    p.projections[3].afferent_section = 0;
+    procedural_circuit circuit(p);
+    auto ref = make_database(circuit, {});
+
+    auto expect_ordered = [](database& db, cell_gid_type gid) {
+        std::vector<segment_location> src;
+        std::vector<std::pair<segment_location, arb::mechanism_desc>> tgt;
+        db.get_sources_and_targets(gid, src, tgt);
+        for (unsigned i = 1; i < tgt.size(); i++) {
+            auto& a = tgt[i - 1].first;
+            auto& b = tgt[i].first;
+            EXPECT_TRUE(a.segment < b.segment || (a.segment == b.segment && a.position <= b.position)) << gid << " " << i;
+        }
+    };
+
+    database_options ordered;
+    ordered.order_targets = true;
+    database_options coalesced = ordered;
+    coalesced.coalesce_synapses = true;
+    database_options compact = ordered;
+    compact.compact_edges = true;
+    database_options streamed = coalesced;
+    streamed.resident_groups = 1;
+
+    // Targets are permuted, merged if coalescing, and connections follow them
+    std::vector<std::pair<database_options, unsigned>> cases = {
+        {ordered, 10}, {coalesced, 5}, {compact, 10}, {streamed, 5}};
+    for (auto& c: cases) {
+        auto db = make_database(circuit, c.first);
+        EXPECT_EQ(std::vector<unsigned>(4, c.second), target_counts(*db, 10, 14));
+        expect_same_synapses(*ref, *db, 10, 14, c.first.compact_edges ? 1.0/65535 : 0);
+        for (cell_gid_type gid = 10; gid < 14; gid++) {
+            expect_ordered(*db, gid);
+        }
+    }
+
+    // Without order_targets the targets are in edge order, which is not location order here
+    std::vector<segment_location> src;
+    std::vector<std::pair<segment_location, arb::mechanism_desc>> tgt;
+    ref->get_sources_and_targets(10, src, tgt);
+    EXPECT_EQ(2u, tgt.front().first.segment);
+}
+
+TEST(database, density_overrides) {
+    std::string components = std::string(DATADIR) + "/../../../example/components";
+    auto p = small_network(4, 8, 2);
+    p.populations[1].model_type = "biophysical";
+    p.populations[1].morphology = components + "/morphologies/soma_branch.swc";
+    p.populations[1].model_template = components + "/density_params/set_pas.json";
+    procedural_circuit base(p);
+
+    // Node i of "tgt" is cell k = 3 - i/2 of group i % 2, so that the group indices run against the gids.
+    // Group "0" overrides e_pas and gl_hh, group "1" only e_pas
+    auto e_pas = [](unsigned group, unsigned k) { return group ? -50. - k : -60. - k; };
+    auto gl_hh = [](unsigned k) { return 0.001*(k + 1); };
+    auto dynamics = [](std::vector<std::shared_ptr<storage_dataset>> datasets) {
+        return std::make_shared<h5_group>("dynamics_params", std::vector<std::shared_ptr<h5_group>>(), std::move(datasets));
+    };
+    auto group = [](std::string name, std::shared_ptr<h5_group> params) {
+        return std::make_shared<h5_group>(name, std::vector<std::shared_ptr<h5_group>>{params},
+                                          std::vector<std::shared_ptr<storage_dataset>>());
+    };
+    auto group_0 = group("0", dynamics({generated_dataset::scalars("pas_0.e_pas", 4, [&](unsigned k) { return e_pas(0, k); }),
+                                        generated_dataset::scalars("hh_0.gl_hh", 4, gl_hh)}));
+    auto group_1 = group("1", dynamics({generated_dataset::scalars("pas_0.e_pas", 4, [&](unsigned k) { return e_pas(1, k); })}));
+
+    rewritten_circuit circuit(base, [](const std::shared_ptr<h5_group>& pop) { return pop; },
+        [&](const std::shared_ptr<h5_group>& pop) {
+            if (pop->name() != "tgt") {
+                return pop;
+            }
+            return replace_members(pop, {generated_dataset::scalars("node_group_id", 8, [](unsigned i) { return i % 2; }),
+                                         generated_dataset::scalars("node_group_index", 8, [](unsigned i) { return 3 - i/2; })},
+                                   {group_0, group_1});
+        });
+
+    // Local cells in groups of an order unrelated to the gids; gid 8 is not local
+    std::vector<cell_gid_type> local = {9, 4, 11, 6, 10, 5, 7};
+    auto db = make_database(circuit, {}, local, 3);
+
+    auto find = [](const std::vector<arb::mechanism_desc>& mechs, const std::string& name) {
+        return std::find_if(mechs.begin(), mechs.end(), [&](const arb::mechanism_desc& m) { return m.name() == name; });
+    };
+
+    auto morph = base.node_types().morph(type_pop_id(0, "tgt"));
+    for (auto gid: local) {
+        unsigned i = gid - 4, g = i % 2, k = 3 - i/2;
+        auto mechs = db->get_density_mechs(gid);
+
+        // Values of set_pas.json, with the overrides of the cell
+        auto& dend = mechs["dend"];
+        ASSERT_EQ(1u, dend.size()) << gid;
+        EXPECT_EQ("pas", dend[0].name());
+        EXPECT_EQ(e_pas(g, k), dend[0].get("e")) << gid;
+        EXPECT_EQ(0.001, dend[0].get("g")) << gid;
+
+        auto& soma = mechs["soma"];
+        ASSERT_EQ(2u, soma.size()) << gid;
+        auto pas = find(soma, "pas"), hh = find(soma, "hh");
+        ASSERT_NE(soma.end(), pas);
+        ASSERT_NE(soma.end(), hh);
+        EXPECT_EQ(-65, pas->get("e"));
+        EXPECT_EQ(0, pas->get("g"));
+        EXPECT_EQ(-70, hh->get("el"));
+        EXPECT_EQ(g ? 0.002 : gl_hh(k), hh->get("gl")) << gid;
+
+        // No morphology dataset in the groups: the morphology of the node type
+        auto m = db->get_cell_morphology(gid);
+        EXPECT_EQ(morph.has_soma(), m.has_soma());
+        EXPECT_EQ(morph.components(), m.components());
+    }
+    EXPECT_THROW(db->get_density_mechs(8), sonata_exception);
+}
+
+TEST(database, scattered_group_indices) {
+    // Source cells with blocks of 10 consecutive edges per slot, whose group indices are permuted,
+    // and more than the coalescing gap of the group reads apart
+    unsigned ns = 4, nt = 40, k = 2, num_edges = nt*k, gap = 5003;
+    auto index = [=](unsigned e) { return (e*37 % num_edges)*gap; };
+    auto position = [](unsigned i) { return (i % 997)/997.; };
+
+    // Reference: the positions stored per edge
+    auto p = small_network(ns, nt, k);
+    p.projections[0].edge_attributes = {{"efferent_section_pos", [=](unsigned e) { return position(index(e)); }}};
+    procedural_circuit ref_circuit(p);
+
+    // The same positions, at the scattered group indices
+    procedural_circuit base(small_network(ns, nt, k));
+    auto positions = std::make_shared<counted_dataset>(
+        generated_dataset::scalars("efferent_section_pos", num_edges*gap, position));
+    rewritten_circuit circuit(base, [&](const std::shared_ptr<h5_group>& pop) {
+        auto group = std::make_shared<h5_group>("0", std::vector<std::shared_ptr<h5_group>>(),
+                                                std::vector<std::shared_ptr<storage_dataset>>{positions});
+        return replace_members(pop, {generated_dataset::scalars("edge_group_index", num_edges, index)}, {group});
+    });
+
+    auto ref = make_database(ref_circuit, {});
+    auto db = make_database(circuit, {});
+    expect_same_network(*ref, *db, ns + nt, 0);
+
+    // Only the values at the group indices are read, not the span of a block
+    EXPECT_LE(positions->elements_read, 2ul*num_edges);
+    EXPECT_GT(positions->elements_read, 0ul);
+}
+
+TEST(database, uniform_edges) {
+    // Every attribute of the edges comes from the edge type, and is folded into a constant
+    auto p = small_network(10, 6, 3);
+    auto& proj = p.projections[0];
+    proj.weight = 0.25;
+    proj.delay = 2;
+    proj.afferent_section = 1;
+    proj.afferent_position = 0.3;
+    proj.efferent_section = 1;
+    proj.efferent_position = 0.6;
+    procedural_circuit uniform(p);
+
+    // The same values, stored per edge in the group
+    auto constant = [](double v) { return [v](unsigned) { return v; }; };
+    proj.edge_attributes = {
+        {"syn_weight", constant(0.25)}, {"delay", constant(2)}, {"nsyns", constant(1)},
+        {"afferent_section_id", constant(1)}, {"afferent_section_pos", constant(0.3)},
+        {"efferent_section_id", constant(1)}, {"efferent_section_pos", constant(0.6)}};
+    procedural_circuit stored(p);
+
+    auto a = make_database(uniform, {});
+    auto b = make_database(stored, {});
+    expect_same_network(*a, *b, 16, 0);
+
+    // The constants are those of the type
+    std::vector<arb::cell_connection> conns;
+    a->get_connections(12, conns);
+    ASSERT_EQ(3u, conns.size());
+    for (auto& c: conns) {
+        EXPECT_EQ(0.25, c.weight);
+        EXPECT_EQ(2, c.delay);
+    }
+    std::vector<segment_location> src;
+    std::vector<std::pair<segment_location, arb::mechanism_desc>> tgt;
+    a->get_sources_and_targets(12, src, tgt);
+    ASSERT_EQ(3u, tgt.size());
+    EXPECT_EQ(1u, tgt[0].first.segment);
+    EXPECT_EQ(0.3, tgt[0].first.position);
+    a->get_sources_and_targets(0, src, tgt);
+    ASSERT_EQ(1u, src.size());
+    EXPECT_EQ(1u, src[0].segment);
+    EXPECT_EQ(0.6, src[0].position);
+}
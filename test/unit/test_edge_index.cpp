@@ -0,0 +1,86 @@
+#include <arbor/cable_cell.hpp>
+
+#include <cstdio>
+#include <vector>
+
+#include "edge_index.hpp"
+#include "sonata_exceptions.hpp"
+
+#include "../gtest.h"
+
+namespace {
+// Edges of every node of `index`, in range order
+std::vector<std::vector<int>> edges_by_node(const edge_index& index) {
+    std::vector<std::vector<int>> out;
+    for (auto n2r: index.node_id_to_ranges) {
+        out.emplace_back();
+        for (int r = n2r.first; r < n2r.second; r++) {
+            for (int e = index.range_to_edge_id[r].first; e < index.range_to_edge_id[r].second; e++) {
+                out.back().push_back(e);
+            }
+        }
+    }
+    return out;
+}
+}
+
+TEST(edge_index, runs) {
+    std::vector<int> ids = {2, 2, 0, 1, 1, 2, 2, 2};
+    auto runs = find_edge_runs(ids, 10, 1);
+    ASSERT_EQ(4u, runs.size());
+    EXPECT_EQ(2, runs[3].node);
+    EXPECT_EQ(15, runs[3].first);
+    EXPECT_EQ(18, runs[3].last);
+
+    // Node 3 has no edges
+    auto index = index_edge_runs(runs, 4, 1);
+    EXPECT_EQ(std::vector<std::vector<int>>({{12}, {13, 14}, {10, 11, 15, 16, 17}, {}}), edges_by_node(index));
+
+    // Runs that continue each other are merged, as when they come from the slices of two ranks
+    index = index_edge_runs({{1, 0, 2}, {1, 2, 3}, {0, 3, 4}}, 2, 1);
+    EXPECT_EQ(2u, index.range_to_edge_id.size());
+
+    EXPECT_THROW(index_edge_runs(runs, 2, 1), sonata_exception);
+}
+
+TEST(edge_index, threads) {
+    // Enough edges and nodes for several threads and two radix passes
+    unsigned num_nodes = 100000, num_edges = 300000;
+    std::vector<int> ids(num_edges);
+    for (unsigned e = 0; e < num_edges; e++) {
+        ids[e] = (e*7919u + e/3) % num_nodes;
+    }
+
+    auto serial = index_edge_runs(find_edge_runs(ids, 0, 1), num_nodes, 1);
+    auto threaded = index_edge_runs(find_edge_runs(ids, 0, 4), num_nodes, 4);
+    EXPECT_EQ(serial.node_id_to_ranges, threaded.node_id_to_ranges);
+    EXPECT_EQ(serial.range_to_edge_id, threaded.range_to_edge_id);
+
+    auto edges = edges_by_node(threaded);
+    unsigned count = 0;
+    for (unsigned n = 0; n < num_nodes; n++) {
+        for (auto e: edges[n]) {
+            EXPECT_EQ((int)n, ids[e]);
+            count++;
+        }
+    }
+    EXPECT_EQ(num_edges, count);
+}
+
+TEST(edge_index, sidecar) {
+    // Written to the working directory, and removed
+    std::string path = "edge_index_sidecar.h5";
+    auto s2t = index_edge_runs(find_edge_runs({0, 1, 1, 0}, 0, 1), 3, 1);
+    auto t2s = index_edge_runs(find_edge_runs({1, 0, 0, 1}, 0, 1), 2, 1);
+    write_index_file(path, "pop", s2t, t2s);
+
+    EXPECT_EQ(nullptr, read_index_file(path, "other"));
+    auto group = read_index_file(path, "pop");
+    ASSERT_NE(nullptr, group);
+    std::remove(path.c_str());
+
+    h5_wrapper ind(group);
+    auto& g = ind[ind.find_group("source_to_target")];
+    EXPECT_EQ(s2t.node_id_to_ranges, g.int_pair_range("node_id_to_ranges", 0, 3));
+    EXPECT_EQ(s2t.range_to_edge_id, g.int_pair_range("range_to_edge_id", 0, 3));
+}
@@ -0,0 +1,66 @@
+#include <string>
+#include <unordered_map>
+
+#include "flat_hash_map.hpp"
+
+#include "../gtest.h"
+
+TEST(flat_hash_map, insert_find) {
+    flat_hash_map<unsigned, std::string> m;
+    EXPECT_TRUE(m.empty());
+    EXPECT_EQ(m.end(), m.find(0));
+
+    for (unsigned i = 0; i < 1000; i++) {
+        m[i*16] = std::to_string(i);
+    }
+    EXPECT_EQ(1000u, m.size());
+
+    for (unsigned i = 0; i < 1000; i++) {
+        auto it = m.find(i*16);
+        ASSERT_NE(m.end(), it);
+        EXPECT_EQ(std::to_string(i), it->second);
+        EXPECT_EQ(0u, m.count(i*16 + 1));
+    }
+
+    auto r = m.insert({16, "x"});
+    EXPECT_FALSE(r.second);
+    EXPECT_EQ("1", r.first->second);
+
+    EXPECT_THROW(m.at(1), std::out_of_range);
+}
+
+TEST(flat_hash_map, erase) {
+    flat_hash_map<unsigned, unsigned> m;
+    std::unordered_map<unsigned, unsigned> ref;
+
+    for (unsigned i = 0; i < 5000; i++) {
+        m[i] = i;
+        ref[i] = i;
+    }
+    for (unsigned i = 0; i < 5000; i += 3) {
+        EXPECT_EQ(1u, m.erase(i));
+        ref.erase(i);
+    }
+    EXPECT_EQ(0u, m.erase(0));
+    EXPECT_EQ(ref.size(), m.size());
+
+    unsigned visited = 0;
+    for (auto& kv: m) {
+        EXPECT_EQ(ref.at(kv.first), kv.second);
+        visited++;
+    }
+    EXPECT_EQ(ref.size(), visited);
+}
+
+TEST(flat_hash_map, copy) {
+    flat_hash_map<std::string, int> m = {{"a", 1}, {"b", 2}};
+    auto c = m;
+    c["a"] = 3;
+
+    EXPECT_EQ(1, m.at("a"));
+    EXPECT_EQ(3, c.at("a"));
+    EXPECT_EQ(2, c.at("b"));
+
+    decltype(c)().swap(c);
+    EXPECT_TRUE(c.empty());
+}
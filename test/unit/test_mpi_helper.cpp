@@ -0,0 +1,48 @@
+#include <arbor/version.hpp>
+
+#ifdef ARB_MPI_ENABLED
+
+#include <vector>
+
+#include "data_management_lib.hpp"
+#include "../../sonata/mpi_helper.hpp"
+
+#include "../gtest.h"
+
+TEST(mpi_helper, gather_in_rounds) {
+    auto r = rank(MPI_COMM_WORLD);
+    auto n = size(MPI_COMM_WORLD);
+
+    // Ranks contribute different counts, so that some are done before the last round
+    std::vector<source_type> values;
+    for (int i = 0; i < 100 + 13*r; i++) {
+        values.emplace_back(i % 7, r + i*0.001);
+    }
+    auto counts = gather_all(values.size(), MPI_COMM_WORLD);
+    auto total = make_index(counts).back();
+
+    std::vector<source_type> expected;
+    for (int j = 0; j < n; j++) {
+        for (int i = 0; i < 100 + 13*j; i++) {
+            expected.emplace_back(i % 7, j + i*0.001);
+        }
+    }
+
+    std::vector<source_type> single(total);
+    allgatherv(values.data(), values.size(), single.data(), counts, MPI_COMM_WORLD);
+    EXPECT_EQ(expected, single);
+
+    for (std::size_t limit: {1u, 7u, 64u, 99u}) {
+        std::vector<source_type> all(total);
+        allgatherv(values.data(), values.size(), all.data(), counts, MPI_COMM_WORLD, limit);
+        EXPECT_EQ(single, all);
+
+        std::vector<source_type> root(r == 0 ? total : 0);
+        gatherv(values.data(), values.size(), root.data(), counts, 0, MPI_COMM_WORLD, limit);
+        if (r == 0) {
+            EXPECT_EQ(single, root);
+        }
+    }
+}
+
+#endif
@@ -0,0 +1,84 @@
+#include <arbor/cable_cell.hpp>
+
+#include <algorithm>
+#include <vector>
+
+#include "procedural_circuit.hpp"
+#include "sonata_exceptions.hpp"
+
+#include "../gtest.h"
+
+namespace {
+procedural_params two_populations(unsigned num_sources, unsigned num_targets, unsigned in_degree) {
+    procedural_params p;
+    p.populations = {{"src", num_sources}, {"tgt", num_targets}};
+    p.projections = {{"src_tgt", "src", "tgt", in_degree}};
+    p.seed = 42;
+    return p;
+}
+}
+
+TEST(procedural_circuit, populations) {
+    procedural_circuit c(two_populations(10, 7, 3));
+
+    auto nodes = c.nodes();
+    EXPECT_TRUE(nodes.verify_nodes());
+    EXPECT_EQ(17, nodes.num_elements());
+    EXPECT_EQ(std::vector<unsigned>({0, 10, 17}), nodes.partitions());
+
+    auto edges = c.edges();
+    EXPECT_TRUE(edges.verify_edges());
+    EXPECT_EQ(21, edges.num_elements());
+}
+
+TEST(procedural_circuit, indices) {
+    // More sources than targets, fewer sources than targets, and as many
+    for (auto sizes: std::vector<std::pair<unsigned, unsigned>>{{13, 5}, {5, 13}, {8, 8}}) {
+        unsigned ns = sizes.first, nt = sizes.second, k = 3;
+        procedural_circuit c(two_populations(ns, nt, k));
+
+        auto edges = c.edges();
+        auto& pop = edges[0];
+        auto& ind = pop[pop.find_group("indicies")];
+        auto& s2t = ind[ind.find_group("source_to_target")];
+        auto& t2s = ind[ind.find_group("target_to_source")];
+
+        auto sources = pop.int_range("source_node_id", 0, nt*k);
+        auto targets = pop.int_range("target_node_id", 0, nt*k);
+
+        // Every edge is found once from its target, and once from its source
+        std::vector<unsigned> from_target(nt*k), from_source(nt*k);
+        for (unsigned t = 0; t < nt; t++) {
+            auto n2r = t2s.int_pair_at("node_id_to_ranges", t);
+            for (int r = n2r.first; r < n2r.second; r++) {
+                auto r2e = t2s.int_pair_at("range_to_edge_id", r);
+                for (int e = r2e.first; e < r2e.second; e++) {
+                    EXPECT_EQ((int)t, targets[e]);
+                    EXPECT_EQ(c.source_of(0, t, e/nt), (unsigned)sources[e]);
+                    from_target[e]++;
+                }
+            }
+        }
+        for (unsigned s = 0; s < ns; s++) {
+            auto n2r = s2t.int_pair_at("node_id_to_ranges", s);
+            for (int r = n2r.first; r < n2r.second; r++) {
+                auto r2e = s2t.int_pair_at("range_to_edge_id", r);
+                for (int e = r2e.first; e < r2e.second; e++) {
+                    EXPECT_EQ((int)s, sources[e]);
+                    from_source[e]++;
+                }
+            }
+        }
+        EXPECT_EQ(std::vector<unsigned>(nt*k, 1), from_target);
+        EXPECT_EQ(std::vector<unsigned>(nt*k, 1), from_source);
+    }
+}
+
+TEST(procedural_circuit, invalid) {
+    auto p = two_populations(10, 10, 1);
+    p.projections[0].source = "none";
+    EXPECT_THROW(procedural_circuit c(p), sonata_exception);
+
+    EXPECT_THROW(procedural_circuit c(two_populations(0, 10, 1)), sonata_exception);
+    EXPECT_THROW(procedural_circuit c(two_populations(1u << 20, 1u << 20, 4096)), sonata_exception);
+}
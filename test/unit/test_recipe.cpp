@@ -0,0 +1,57 @@
+#include <arbor/domain_decomposition.hpp>
+
+#include <string>
+#include <vector>
+
+#include "procedural_circuit.hpp"
+#include "sonata_recipe.hpp"
+
+#include "../gtest.h"
+
+TEST(recipe, local_probes) {
+    procedural_params p;
+    p.populations = {{"src", 10}, {"tgt", 6}};
+    p.projections = {{"src_tgt", "src", "tgt", 2}};
+    procedural_circuit circuit(p);
+
+    std::vector<probe_info> probes = {
+        {"v", "tgt", {1, 4}, 0, 0.5, "some_local"},
+        {"v", "tgt", {4, 5}, 0, 0.5, "none_local"},
+        {"v", "tgt", {},     0, 0.5, "population"},
+        {"v", "other", {1},  0, 0.5, "unknown"},
+        {"v", "src", {2},    0, 0.5, "source"}};
+    sonata_recipe recipe(circuit, {}, {}, probes, {});
+
+    // Gids 2, 11 and 12 are on this rank, the other cells on rank 1
+    std::vector<cell_gid_type> local = {2, 11, 12};
+    arb::domain_decomposition decomp;
+    decomp.num_domains = 2;
+    decomp.domain_id = 0;
+    decomp.num_local_cells = local.size();
+    decomp.num_global_cells = recipe.num_cells();
+    decomp.groups = {{recipe.get_cell_kind(2), {2}, arb::backend_kind::multicore},
+                     {recipe.get_cell_kind(11), {11, 12}, arb::backend_kind::multicore}};
+    decomp.gid_domain = [local](cell_gid_type gid) {
+        return std::find(local.begin(), local.end(), gid) != local.end() ? 0 : 1;
+    };
+    recipe.build_local_maps(decomp);
+
+    auto files = [&](cell_gid_type gid) {
+        std::vector<std::string> f;
+        for (unsigned i = 0; i < recipe.num_probes(gid); i++) {
+            recipe.get_probe({gid, i});
+            f.push_back(recipe.get_probe_file({gid, i}));
+        }
+        return f;
+    };
+
+    // Node sets keep their local node ids only, and are dropped if none is local
+    EXPECT_EQ((std::vector<std::string>{"some_local", "population"}), files(11));
+    EXPECT_EQ((std::vector<std::string>{"population"}), files(12));
+    EXPECT_EQ((std::vector<std::string>{"source"}), files(2));
+
+    // Only the probes covering a whole population remain on the cells of other ranks
+    EXPECT_EQ((std::vector<std::string>{"population"}), files(14));
+    EXPECT_EQ((std::vector<std::string>{"population"}), files(15));
+    EXPECT_TRUE(files(3).empty());
+}